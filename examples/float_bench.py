@@ -0,0 +1,80 @@
+import argparse
+import struct
+import time
+from io import BytesIO
+from random import Random
+
+import sesam_rapidjson
+
+
+class CollectingHandler:
+
+    def __init__(self, exact_floats):
+        self.exact_floats = exact_floats
+        self.values = []
+        self.error = None
+
+    def handle_dict(self, entity):
+        self.values.extend(entity["f"])
+
+    def handle_end_stream(self):
+        pass
+
+    def handle_error(self, error_code, offset, line_no, column, fail_reason):
+        self.error = sesam_rapidjson.RapidJSONParseError(error_code, offset, line_no, column, fail_reason)
+
+
+def make_texts(kind, count, rng):
+    if kind == "prices":
+        return ["%d.%02d" % (rng.randrange(100000), rng.randrange(100)) for _ in range(count)]
+    if kind == "coordinates":
+        return ["%.6f" % rng.uniform(-180, 180) for _ in range(count)]
+
+    # Shortest round trip representations of doubles spread over the whole range, like other parsers write them
+    texts = []
+    while len(texts) < count:
+        value = struct.unpack("<d", struct.pack("<Q", rng.getrandbits(64)))[0]
+        if value == value and value not in (float("inf"), float("-inf")):
+            texts.append(repr(value))
+    return texts
+
+
+def make_payload(texts, per_entity=10):
+    entities = ['{"f": [%s]}' % ",".join(texts[i:i + per_entity]) for i in range(0, len(texts), per_entity)]
+    return ("[" + ",".join(entities) + "]").encode("utf-8")
+
+
+def run(payload, rounds, exact_floats=False, do_float_as_decimal=False):
+    best = None
+    for _ in range(rounds):
+        handler = CollectingHandler(exact_floats)
+        start_time = time.perf_counter()
+        sesam_rapidjson.parse_dict(BytesIO(payload), handler, None, False, do_float_as_decimal)
+        time_used = time.perf_counter() - start_time
+        if handler.error is not None:
+            raise handler.error
+        best = time_used if best is None else min(best, time_used)
+    return handler.values, best
+
+
+parser = argparse.ArgumentParser(description='Compare the float conversion modes of parse_dict: rapidjson\'s '
+                                             'default conversion, exact floats and decimal mode')
+parser.add_argument('--numbers', dest='numbers', type=int, default=200000, help="Numbers per payload")
+parser.add_argument('--rounds', dest='rounds', type=int, default=5, help="Parses per mode, the best one counts")
+parser.add_argument('--seed', dest='seed', type=int, default=42, help="Seed for the random numbers")
+
+args = parser.parse_args()
+rng = Random(args.seed)
+
+for kind in ("doubles", "prices", "coordinates"):
+    texts = make_texts(kind, args.numbers, rng)
+    payload = make_payload(texts)
+    expected = [float(text) for text in texts]
+    print("%s (%d numbers, %d bytes):" % (kind, len(texts), len(payload)))
+
+    for name, options in (("default", {}), ("exact_floats", {"exact_floats": True}),
+                          ("decimal", {"do_float_as_decimal": True})):
+        values, time_used = run(payload, args.rounds, **options)
+        wrong = sum(1 for value, exact in zip(values, expected) if float(value) != exact)
+        print("  %-13s %7.1f ms  %6.1f Mnumbers/sec  %d not exact" %
+              (name, time_used * 1000, len(texts) / time_used / 1e6, wrong))
@@ -0,0 +1,86 @@
+import argparse
+import sys
+import time
+from io import BytesIO
+from threading import Barrier, Thread
+
+import sesam_rapidjson
+
+
+class CountingHandler:
+
+    def __init__(self):
+        self.entities = 0
+        self.error = None
+
+    def handle_dict(self, entity):
+        self.entities += 1
+
+    def handle_end_stream(self):
+        pass
+
+    def handle_error(self, error_code, offset, line_no, column, fail_reason):
+        self.error = sesam_rapidjson.RapidJSONParseError(error_code, offset, line_no, column, fail_reason)
+
+
+def make_payload(num_entities):
+    entity = '{"_id": "%s@example.com", "_deleted": false, "_updated": %s, "_ts": 1505336456740055, ' \
+             '"name": "Goldia Grant", "company": "Kuphal, Crooks and Boyle", "score": 3.1416, ' \
+             '"tags": ["a", "b", "c"], "address": {"street": "Unit 7101 Box 9011", "zip": "00059"}}'
+    return ("[" + ",".join(entity % (i, i) for i in range(num_entities)) + "]").encode("utf-8")
+
+
+def worker(payload, rounds, barrier, results, index):
+    barrier.wait()
+    entities = 0
+    for _ in range(rounds):
+        handler = CountingHandler()
+        sesam_rapidjson.parse_dict(BytesIO(payload), handler, None, False, False)
+        if handler.error is not None:
+            raise handler.error
+        entities += handler.entities
+    results[index] = entities
+
+
+def run(num_threads, payload, rounds):
+    barrier = Barrier(num_threads + 1)
+    results = [0] * num_threads
+    threads = [Thread(target=worker, args=(payload, rounds, barrier, results, i)) for i in range(num_threads)]
+
+    for thread in threads:
+        thread.start()
+
+    barrier.wait()
+    start_time = time.monotonic()
+
+    for thread in threads:
+        thread.join()
+
+    return sum(results), time.monotonic() - start_time
+
+
+parser = argparse.ArgumentParser(description='Stress test parallel parse_dict calls (run on a free-threaded '
+                                             'python to see them scale)')
+parser.add_argument('--max-threads', dest='max_threads', type=int, default=8, help="Highest thread count to try")
+parser.add_argument('--entities', dest='entities', type=int, default=10000, help="Entities per payload")
+parser.add_argument('--rounds', dest='rounds', type=int, default=20, help="Payloads parsed per thread")
+
+args = parser.parse_args()
+
+gil_enabled = getattr(sys, "_is_gil_enabled", lambda: True)()
+print("Python %s, GIL %s" % (sys.version.split()[0], "enabled" if gil_enabled else "disabled"))
+
+payload = make_payload(args.entities)
+baseline = None
+num_threads = 1
+
+while num_threads <= args.max_threads:
+    entities, time_used = run(num_threads, payload, args.rounds)
+    per_sec = entities / time_used
+    if baseline is None:
+        baseline = per_sec
+
+    print("%2d threads: %d entities in %.2f seconds (%d entities/sec, %.2fx speedup)" %
+          (num_threads, entities, time_used, per_sec, per_sec / baseline))
+
+    num_threads *= 2
@@ -0,0 +1,77 @@
+import argparse
+import json
+import time
+from io import BytesIO
+
+import sesam_rapidjson
+
+
+class CountingHandler:
+
+    def __init__(self):
+        self.strings = 0
+        self.error = None
+
+    def handle_dict(self, entity):
+        self.strings += len(entity["s"])
+
+    def handle_end_stream(self):
+        pass
+
+    def handle_error(self, error_code, offset, line_no, column, fail_reason):
+        self.error = sesam_rapidjson.RapidJSONParseError(error_code, offset, line_no, column, fail_reason)
+
+
+# Text that makes strings of each kind python has: ASCII, Latin-1 (one byte per character, but not ASCII), the
+# basic multilingual plane (two bytes) and beyond it (four bytes)
+UNITS = {
+    "ascii": "abcdefghij",
+    "latin-1": "Åse Ørn æ",
+    "cjk": "東京都の天気",
+    "emoji": "ok \U0001F600 ",
+}
+
+
+def make_payload(unit, length, count, per_entity=10):
+    text = (unit * (length // len(unit) + 1))[:length]
+    entities = [json.dumps({"s": [text] * per_entity}, ensure_ascii=False) for _ in range(count // per_entity)]
+    return ("[" + ",".join(entities) + "]").encode("utf-8")
+
+
+def run(payload, rounds):
+    best = None
+    for _ in range(rounds):
+        handler = CountingHandler()
+        start_time = time.perf_counter()
+        sesam_rapidjson.parse_dict(BytesIO(payload), handler, None, False, False)
+        time_used = time.perf_counter() - start_time
+        if handler.error is not None:
+            raise handler.error
+        best = time_used if best is None else min(best, time_used)
+    return handler.strings, best
+
+
+def run_json(payload, rounds):
+    best = None
+    for _ in range(rounds):
+        start_time = time.perf_counter()
+        json.loads(payload)
+        time_used = time.perf_counter() - start_time
+        best = time_used if best is None else min(best, time_used)
+    return best
+
+
+parser = argparse.ArgumentParser(description='Measure how fast parse_dict builds python strings of different kinds '
+                                             'and lengths, with the json module as a reference')
+parser.add_argument('--strings', dest='strings', type=int, default=200000, help="Strings per payload")
+parser.add_argument('--rounds', dest='rounds', type=int, default=5, help="Parses per payload, the best one counts")
+
+args = parser.parse_args()
+
+for kind, unit in UNITS.items():
+    for length in (8, 32, 256):
+        payload = make_payload(unit, length, args.strings)
+        strings, time_used = run(payload, args.rounds)
+        json_time_used = run_json(payload, args.rounds)
+        print("%-8s %4d chars: %7.1f ms  %6.2f Mstrings/sec  (json: %7.1f ms)" %
+              (kind, length, time_used * 1000, strings / time_used / 1e6, json_time_used * 1000))
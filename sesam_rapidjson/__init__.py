@@ -7,13 +7,171 @@ from sesam_rapidjson_pybind import parse_string
 from sesam_rapidjson_pybind import parse_strings
 from sesam_rapidjson_pybind import parse_dict
 from sesam_rapidjson_pybind import parse8601
-from .exceptions import RapidJSONParseError
+from sesam_rapidjson_pybind import parse_dict_many
+from sesam_rapidjson_pybind import shutdown_pool
+from sesam_rapidjson_pybind import configure_pool
+from sesam_rapidjson_pybind import pool_size
+from sesam_rapidjson_pybind import reset_pool_after_fork
+from sesam_rapidjson_pybind import pool_begin_blocking, pool_end_blocking
+from sesam_rapidjson_pybind import ring_initialize
+from sesam_rapidjson_pybind import parse_to_ring
+from sesam_rapidjson_pybind import SharedRingReader
+from sesam_rapidjson_pybind import IncrementalParser
+from sesam_rapidjson_pybind import CancelToken
+from sesam_rapidjson_pybind import validate_source
+from sesam_rapidjson_pybind import sample_source
+from sesam_rapidjson_pybind import dumps as _dumps
+from .exceptions import RapidJSONParseError, RapidJSONEntityError
+from .predicates import compile_filter
+from .raw import RawJSON
 
-__all__ = ["parse", "parse_string", "parse_strings", "parse_dict", "parse8601", "RapidJSONParseError"]
+__all__ = ["parse", "parse_string", "parse_strings", "parse_dict", "parse8601", "parse_many", "parse_parallel",
+           "StreamingParser", "AsyncJSONParser", "ByteBudgetQueue", "validate", "count_entities", "ValidationResult",
+           "sample", "configure_pool", "pool_size", "shutdown_pool", "RapidJSONParseError",
+           "RapidJSONEntityError", "compile_filter", "RawJSON", "dumps"]
 
-from threading import Thread
+import atexit
+import multiprocessing
+import os
+import random
+from collections import deque, namedtuple
+from threading import Condition, Event, Thread
 from queue import Queue
 
+# The native worker threads must be stopped while the interpreter is still fully alive
+atexit.register(shutdown_pool)
+
+if hasattr(os, "register_at_fork"):
+    os.register_at_fork(after_in_child=reset_pool_after_fork)
+
+if os.environ.get("SESAM_RAPIDJSON_POOL_SIZE"):
+    configure_pool(int(os.environ["SESAM_RAPIDJSON_POOL_SIZE"]))
+
+
+class ByteBudgetQueue:
+    """Queue bounded by the (estimated) size of the items in it rather than by their number. put() blocks when the
+    queue holds 'high_watermark' bytes or more, and then until the consumer has brought it down to 'low_watermark'
+    bytes. An item is always accepted by an empty queue, so a single huge entity can't block the producer forever.
+
+    Items put without a size count as 'high_watermark / max_items' bytes, which bounds a queue of such items at
+    about 'max_items' items. Once the consumer has closed the queue, put() drops the items instead of blocking."""
+
+    def __init__(self, high_watermark=64 * 1024 * 1024, low_watermark=None, max_items=10000):
+        self._high_watermark = high_watermark
+        self._low_watermark = high_watermark // 2 if low_watermark is None else low_watermark
+        self._default_size = max(1, high_watermark // max_items)
+        self._items = deque()
+        self._bytes = 0
+        self._paused = False
+        self._closed = False
+        self._condition = Condition()
+
+    def put(self, item, size=None):
+        if size is None:
+            size = self._default_size
+
+        with self._condition:
+            # A parse on the shared pool must not hold on to its pool thread while it waits: a consumer reading
+            # more pool parsers than there are pool threads in turn would wait for one that never gets to start
+            blocking = False
+            try:
+                while self._items and (self._paused or self._bytes >= self._high_watermark) and not self._closed:
+                    self._paused = True
+                    if not blocking:
+                        blocking = pool_begin_blocking()
+                    self._condition.wait()
+            finally:
+                if blocking:
+                    pool_end_blocking()
+
+            if self._closed:
+                return
+
+            self._items.append((item, size))
+            self._bytes += size
+            self._condition.notify_all()
+
+    def get(self):
+        with self._condition:
+            while not self._items:
+                self._condition.wait()
+
+            item, size = self._items.popleft()
+            self._bytes -= size
+            if self._paused and self._bytes <= self._low_watermark:
+                self._paused = False
+            self._condition.notify_all()
+            return item
+
+    def close(self):
+        with self._condition:
+            self._closed = True
+            self._items.clear()
+            self._bytes = 0
+            self._condition.notify_all()
+
+    def qsize(self):
+        return len(self._items)
+
+    def buffered_bytes(self):
+        return self._bytes
+
+
+ValidationResult = namedtuple("ValidationResult", ["valid", "entities", "bytes", "error"])
+
+
+def validate(source):
+    """Checks that a file (a path) or a binary stream holds well-formed JSON (including valid UTF-8) without building
+    any python objects, and with the GIL released. Returns a ValidationResult with the number of entities, the number
+    of bytes read and, if the JSON is not well-formed, the first error as a RapidJSONParseError."""
+    if isinstance(source, (str, bytes, os.PathLike)):
+        source = os.fsdecode(source)
+
+    valid, entities, size, error_code, offset, line_no, column = validate_source(source)
+    error = None if valid else RapidJSONParseError(error_code, offset, line_no, column, "")
+    return ValidationResult(valid, entities, size, error)
+
+
+def count_entities(source):
+    """Counts the entities in a file (a path) or a stream without parsing them into python objects. Raises
+    RapidJSONParseError if the JSON is not well-formed."""
+    result = validate(source)
+    if result.error is not None:
+        raise result.error
+    return result.entities
+
+
+def dumps(obj, default=None):
+    """Writes the kind of values the parsers build (dicts, lists, tuples, strings, numbers, booleans, None and
+    Decimals) as JSON, and returns it as bytes. RawJSON values are written as they are, so the raw subtrees of a parsed
+    entity go back out without ever being built, and other bytes, such as the values and keys of 'strings_as_bytes' and
+    'keys_as_bytes', are written as UTF-8 strings. As with json.dumps(), 'default' is called with any other value,
+    such as one made by a transit mapping, and should return something that can be written or raise a TypeError."""
+    return _dumps(obj, RawJSON, default)
+
+
+def sample(source, k=None, seed=None, stride=None, transit_mapping=None, do_float_as_int=False,
+           do_float_as_decimal=False):
+    """Returns a sample of the entities in a file (a path) or a stream, in document order: 'k' entities picked
+    uniformly at random (with the given seed) or, with 'stride', every 'stride'-th entity (at most 'k' of them if
+    'k' is given). The document is scanned without building python objects; only the sampled entities are parsed.
+    The structure of the whole document is checked, the contents of the other entities are not validated."""
+    if stride is None and k is None:
+        raise ValueError("sample() needs 'k' and/or 'stride'")
+
+    if isinstance(source, (str, bytes, os.PathLike)):
+        source = os.fsdecode(source)
+
+    if seed is None:
+        seed = random.getrandbits(63)
+
+    handler = _CollectingHandler()
+    sample_source(source, handler, k or 0, stride or 0, seed, transit_mapping, do_float_as_int,
+                  do_float_as_decimal)
+    if handler.error is not None:
+        raise handler.error
+    return handler.entities
+
 
 class JSONDictHandler:
 
@@ -23,8 +181,8 @@ class JSONDictHandler:
         self.name_context = []
         self._queue = queue
 
-    def handle_dict(self, entity):
-        self._queue.put(entity)
+    def handle_dict(self, entity, size=None):
+        self._queue.put(entity, size)
 
     def handle_end_stream(self):
         self._queue.put(None)
@@ -33,17 +191,145 @@ class JSONDictHandler:
         self._queue.put(RapidJSONParseError(error_code, offset, line_no, column, fail_reason))
         self._queue.put(None)
 
+    def handle_entity_error(self, error_code, offset, line_no, column, fail_reason, raw):
+        self._queue.put(RapidJSONEntityError(error_code, offset, line_no, column, fail_reason, raw), len(raw))
+
+    def handle_exception(self, exception):
+        self._queue.put(exception)
+        self._queue.put(None)
+
+
+class JSONBatchHandler(JSONDictHandler):
+    """Gets the entities in lists, see the batch options of JSONParser"""
+
+    def __init__(self, queue, batch_size=1000, batch_bytes=0, batch_timeout=0.0):
+        super().__init__(queue)
+        self.batch_size = batch_size
+        self.batch_bytes = batch_bytes
+        self.batch_timeout = batch_timeout
+
+    def handle_batch(self, entities, size=None):
+        self._queue.put(entities, size)
+
 
 class JSONParser:
 
     def __init__(self, stream, handler=JSONDictHandler, transit_mapping=None, do_float_as_int=False,
-                 do_float_as_decimal=False):
-        self._queue = Queue(maxsize=10000)
-        self._handler = handler(self._queue)
+                 do_float_as_decimal=False, use_pool=False, batch_size=None, batch_bytes=None, batch_timeout=None,
+                 max_buffer_bytes=64 * 1024 * 1024, resume_buffer_bytes=None, limit=None, offset=None,
+                 tolerant=False, on_error=None, fields=None, pointers=None, defaults=None, where=None,
+                 contains=None, item_path=None, kvitems=False, format="json", raw_depth=None, raw_paths=None,
+                 strings_as_bytes=False, keys_as_bytes=False, validate_utf8=True, exact_floats=False):
+        # The parser pauses when the entities waiting to be consumed add up to 'max_buffer_bytes' of JSON, and goes
+        # on when they are down to 'resume_buffer_bytes' (by default half of 'max_buffer_bytes')
+        self._queue = ByteBudgetQueue(max_buffer_bytes, resume_buffer_bytes)
+        # In batch mode the entities are handed over in lists of up to 'batch_size' entities or about 'batch_bytes'
+        # bytes of JSON. A list is also handed over when its first entity has waited for 'batch_timeout' seconds.
+        self._batched = batch_size is not None or batch_bytes is not None
+        if batch_timeout is not None and not self._batched:
+            raise ValueError("'batch_timeout' needs 'batch_size' or 'batch_bytes'")
+        if self._batched:
+            if handler is not JSONDictHandler:
+                raise ValueError("A 'handler' can't be used with 'batch_size' or 'batch_bytes'")
+            self._handler = JSONBatchHandler(self._queue, batch_size or 0, batch_bytes or 0, batch_timeout or 0.0)
+        else:
+            self._handler = handler(self._queue)
+        # Have the native parser pass the size of each entity (or batch) along, which the methods here take. Handlers
+        # overriding handle_dict() get the usual 'handle_dict(entity)' call.
+        self._handler.pass_size = type(self._handler).handle_dict is JSONDictHandler.handle_dict
+        # The native parser stops reading after 'limit' entities, or as soon as the cancel token is cancelled
+        self._handler.limit = limit
+        # The first 'offset' entities are skipped with a scanner that only looks at brackets and quotes. They are not
+        # validated. Like 'limit' it counts the entities that are yielded.
+        self._handler.offset = offset
+        # In tolerant mode an invalid entity in a top level array doesn't end the parse: it is skipped and its error
+        # (a RapidJSONEntityError) is added to 'errors' and passed to 'on_error', if given
+        self._handler.tolerant = tolerant
+        self._on_error = on_error
+        self.errors = []
+        # Only the given members of the entities are built, the rest is skipped by the native parser. A field is a
+        # member name or a list of names, i.e. ["_id", ["address", "city"]]. Paths go into arrays.
+        if fields is not None:
+            self._handler.fields = [field if isinstance(field, str) else list(field) for field in fields]
+        # Instead of the entities, tuples of the values at the given JSON Pointers (i.e. "/address/0/city") are
+        # yielded, with the matching item of 'defaults' (or None) where an entity has no such value. Only those
+        # values are built.
+        if pointers is not None:
+            if fields is not None:
+                raise ValueError("'fields' and 'pointers' can't be used together")
+            if defaults is not None and len(defaults) != len(pointers):
+                raise ValueError("There must be a default for each JSON Pointer")
+            self._handler.pointers = list(pointers)
+            self._handler.pointer_defaults = None if defaults is None else list(defaults)
+        # Only the entities matching 'where' are built, i.e. '_deleted == false and type in {"a", "b"}' (see
+        # compile_filter()). The native parser drops the others as soon as a condition fails.
+        if where is not None:
+            self._handler.where = compile_filter(where) if isinstance(where, str) else list(where)
+        # Only the entities whose raw JSON text contains one of these strings (i.e. '"_id": "42"') are parsed. The
+        # others are skipped by a scanner and a SIMD substring search, without being tokenized or validated.
+        if contains is not None:
+            if isinstance(contains, (str, bytes)):
+                contains = [contains]
+            contains = [pattern.encode("utf-8") if isinstance(pattern, str) else bytes(pattern)
+                        for pattern in contains]
+            if not contains:
+                raise ValueError("'contains' must have at least one string")
+            self._handler.contains = contains
+        # The entities are the values at an ijson style prefix instead of the elements of the top level array, i.e.
+        # "data.items.item" for the elements of the array at data.items. With 'kvitems' the prefix names an object,
+        # and (name, value) tuples of its members are yielded. The rest of the document is skipped.
+        if item_path is not None:
+            if tolerant or contains is not None or format != "json":
+                raise ValueError("'item_path' can't be used with 'tolerant', 'contains' or 'format'")
+            self._handler.item_path = item_path.split(".") if isinstance(item_path, str) else list(item_path)
+            if self._handler.item_path == [""]:
+                self._handler.item_path = []
+            self._handler.item_key_value = kvitems
+        # The stream is a single JSON document ("json"), one document per line ("ndjson", see https://ndjson.org)
+        # or documents one after the other ("concat"). Each document is parsed as a single document would be, so a
+        # top level object is an entity. 'offset' counts documents.
+        if format not in ("json", "ndjson", "concat"):
+            raise ValueError("Unknown format %r" % (format,))
+        if format == "concat" and (tolerant or contains is not None):
+            raise ValueError("'tolerant' and 'contains' can't be used with the 'concat' format")
+        self._handler.format = format
+        # The objects and arrays 'raw_depth' levels into the entities (1 is the values of their members), or at the
+        # given paths (like 'fields'), are not built but yielded as RawJSON, the bytes of their JSON text
+        if raw_depth is not None or raw_paths is not None:
+            if pointers is not None:
+                raise ValueError("'raw_depth' and 'raw_paths' can't be used with 'pointers'")
+            if raw_depth is not None:
+                if raw_depth < 1:
+                    raise ValueError("'raw_depth' must be at least 1")
+                self._handler.raw_depth = raw_depth
+            if raw_paths is not None:
+                raw_paths = [path if isinstance(path, str) else list(path) for path in raw_paths]
+                if any(len(path) == 0 for path in raw_paths):
+                    raise ValueError("A raw path can't be empty")
+                self._handler.raw_paths = raw_paths
+            self._handler.raw_type = RawJSON
+        # String values and/or member names are yielded as bytes, straight from the parser's buffer and without
+        # being decoded. They are checked for valid UTF-8 unless 'validate_utf8' is false.
+        self._handler.strings_as_bytes = strings_as_bytes
+        self._handler.keys_as_bytes = keys_as_bytes
+        self._handler.validate_utf8 = validate_utf8
+        # Floats are converted to the closest double, so they round trip exactly, instead of with rapidjson's default
+        # conversion, which can be off in the last bit. Integers are not affected.
+        if exact_floats and do_float_as_decimal:
+            raise ValueError("'exact_floats' can't be used with 'do_float_as_decimal'")
+        self._handler.exact_floats = exact_floats
+        self._cancel_token = CancelToken()
+        self._handler.cancel_token = self._cancel_token
+        self._batches = None
         self._stream = stream
         self._sentinel = None
         self._transit_mapping = transit_mapping
-        self._thread = Thread(name="JSONParser", target=self._run)
+        # Parse on the shared native thread pool (see configure_pool()) instead of starting a thread per stream
+        self._use_pool = use_pool
+        if use_pool:
+            self._pool_done = Event()
+        else:
+            self._thread = Thread(name="JSONParser", target=self._run)
         # Output float as an int, if it has no fractions
         self._do_float_as_int = do_float_as_int
         # Parse floats as python Decimals, keeping the precision (i.e. [1.0, 2.00] -> [Decimal("1.0"), Decimal("2.00")]
@@ -60,16 +346,67 @@ class JSONParser:
             self._queue.put(None)
 
     def get_entities(self):
-        self._thread.start()
+        if not self._batched:
+            yield from self._get_items()
+            return
+
+        for batch in self._get_items():
+            yield from batch
 
+    def batches(self):
+        """Yields the entities in lists, as they are handed over by the native parser in batch mode"""
+        if not self._batched:
+            raise ValueError("batches() needs a JSONParser created with 'batch_size' and/or 'batch_bytes'")
+
+        # Stop the entity iterator from starting a second parse
+        self._parse_iter = (e for e in ())
+        self._batches = self._get_items()
+        return self._batches
+
+    def _get_items(self):
+        if self._use_pool:
+            parse_dict_many([self._stream], [self._handler], self._pool_done.set, self._transit_mapping,
+                            self._do_float_as_int, self._do_float_as_decimal)
+        else:
+            self._thread.start()
+
+        finished = False
         try:
             for value in iter(self._queue.get, self._sentinel):
+                if isinstance(value, RapidJSONEntityError):
+                    self.errors.append(value)
+                    if self._on_error is not None:
+                        self._on_error(value)
+                    continue
                 if isinstance(value, BaseException):
                     raise value
 
                 yield value
+            finished = True
         finally:
-            self._thread.join()
+            if not finished:
+                # The consumer stopped early, stop the parser instead of letting it parse on into a full queue
+                self._cancel_token.cancel()
+                self._queue.close()
+
+            if self._use_pool:
+                self._pool_done.wait()
+            else:
+                self._thread.join()
+
+    def close(self):
+        """Stops the parser and waits for it to let go of the stream. Entities not consumed yet are dropped."""
+        self._cancel_token.cancel()
+        self._queue.close()
+        self._parse_iter.close()
+        if self._batches is not None:
+            self._batches.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
 
     def __iter__(self):
         return self
@@ -81,3 +418,310 @@ class JSONParser:
         return next(self._parse_iter)
 
     __next__ = next
+
+
+_ENTITY = 0
+_END = 1
+_ERROR = 2
+
+
+class _SourceHandler:
+    """Handler for one of the sources of a parse_many() call. It tags everything it gets with the index of the
+    source, and drops it all once the consumer has gone away. The native parser stops as soon as the shared
+    'cancel_token' is cancelled, and sources that haven't started by then are not read at all."""
+
+    def __init__(self, queue, index, state, cancel_token):
+        self._queue = queue
+        self._index = index
+        self._state = state
+        self.cancel_token = cancel_token
+
+    def _put(self, kind, value):
+        if not self._state["cancelled"]:
+            self._queue.put((self._index, kind, value))
+
+    def handle_dict(self, entity):
+        self._put(_ENTITY, entity)
+
+    def handle_end_stream(self):
+        self._put(_END, None)
+
+    def handle_error(self, error_code, offset, line_no, column, fail_reason):
+        self._put(_ERROR, RapidJSONParseError(error_code, offset, line_no, column, fail_reason))
+
+    def handle_exception(self, exception):
+        self._put(_ERROR, exception)
+        self._put(_END, None)
+
+
+def parse_many(sources, transit_mapping=None, do_float_as_int=False, do_float_as_decimal=False, ordered=False,
+               maxsize=10000):
+    """Parses many files and/or streams concurrently on the shared native thread pool and yields
+    (source, entity) tuples. Sources that are paths are read natively without holding the GIL.
+
+    By default entities are yielded in the order they are parsed, interleaved between the sources. If 'ordered'
+    is True all entities from a source are yielded before any entities from the next one (entities from later
+    sources are buffered in memory until it is their turn)."""
+    sources = list(sources)
+    targets = [os.fspath(source) if isinstance(source, (str, bytes, os.PathLike)) else source
+               for source in sources]
+
+    queue = Queue(maxsize=maxsize)
+    state = {"cancelled": False}
+    cancel_token = CancelToken()
+    handlers = [_SourceHandler(queue, index, state, cancel_token) for index in range(len(sources))]
+    pending = [deque() for _ in sources]
+    current = 0
+    started = False
+    done = False
+
+    try:
+        parse_dict_many(targets, handlers, lambda: queue.put((None, None, None)), transit_mapping,
+                        do_float_as_int, do_float_as_decimal)
+        started = True
+
+        while True:
+            index, kind, value = queue.get()
+            if index is None:
+                done = True
+                break
+
+            if not ordered:
+                if kind == _ERROR:
+                    raise value
+                elif kind == _ENTITY:
+                    yield sources[index], value
+                continue
+
+            pending[index].append((kind, value))
+
+            while current < len(sources) and pending[current]:
+                kind, value = pending[current].popleft()
+                if kind == _END:
+                    current += 1
+                elif kind == _ERROR:
+                    raise value
+                else:
+                    yield sources[current], value
+    finally:
+        if started and not done:
+            # Stop the remaining parse jobs, and wait for them without blocking on a queue nobody reads
+            state["cancelled"] = True
+            cancel_token.cancel()
+            while queue.get()[0] is not None:
+                pass
+
+
+class _RingHandler:
+    """Collects the entities a SharedRingReader decodes from one worker's ring, tagged with the source they came
+    from. The worker parses its sources in order and ends each of them with an end-of-stream event."""
+
+    def __init__(self, sources):
+        self._sources = sources
+        self._index = 0
+        self.items = []
+        self.error = None
+
+    def handle_dict(self, entity):
+        self.items.append((self._sources[self._index], entity))
+
+    def handle_end_stream(self):
+        self._index += 1
+
+    def handle_error(self, error_code, offset, line_no, column, fail_reason):
+        if self.error is None:
+            self.error = RapidJSONParseError(error_code, offset, line_no, column, fail_reason)
+
+    def handle_exception(self, exception):
+        if self.error is None:
+            self.error = exception
+
+
+def _parse_parallel_worker(shared_memory_name, paths, do_float_as_decimal):
+    from multiprocessing.shared_memory import SharedMemory
+
+    shared_memory = SharedMemory(name=shared_memory_name)
+    try:
+        parse_to_ring(shared_memory.buf, paths, do_float_as_decimal)
+    finally:
+        shared_memory.close()
+
+
+def parse_parallel(paths, workers=None, transit_mapping=None, do_float_as_int=False, do_float_as_decimal=False,
+                   ring_size=16 * 1024 * 1024, mp_context=None):
+    """Parses a list of files in several worker processes and yields (path, entity) tuples.
+
+    The workers parse natively without building any python objects. They write the entities in a compact binary
+    form to a shared memory ring per worker, and this process decodes them into python objects. That is a lot
+    cheaper than pickling dicts across multiprocessing pipes. The files are spread round-robin over the workers;
+    entities from different files are interleaved."""
+    from multiprocessing.shared_memory import SharedMemory
+
+    sources = list(paths)
+    paths = [os.fspath(path) for path in sources]
+    workers = max(1, min(workers or os.cpu_count() or 1, len(paths)))
+    context = mp_context or multiprocessing.get_context()
+
+    shared_memories = []
+    readers = []
+    processes = []
+
+    try:
+        for index in range(min(workers, len(paths))):
+            shared_memory = SharedMemory(create=True, size=ring_size)
+            shared_memories.append(shared_memory)
+            ring_initialize(shared_memory.buf)
+
+            handler = _RingHandler(sources[index::workers])
+            readers.append((SharedRingReader(shared_memory.buf, handler, transit_mapping, do_float_as_int),
+                            handler))
+
+            process = context.Process(target=_parse_parallel_worker, name="JSONParser-%s" % index, daemon=True,
+                                      args=(shared_memory.name, paths[index::workers], do_float_as_decimal))
+            process.start()
+            processes.append(process)
+
+        active = list(range(len(readers)))
+        timeout_ms = 0
+
+        while active:
+            records_read = 0
+
+            for index in list(active):
+                reader, handler = readers[index]
+                records = reader.read(1000, timeout_ms)
+
+                items, handler.items = handler.items, []
+                for item in items:
+                    yield item
+
+                if handler.error is not None:
+                    raise handler.error
+
+                if records < 0:
+                    active.remove(index)
+                    processes[index].join()
+                elif records > 0:
+                    records_read += records
+                elif processes[index].exitcode is not None and reader.read(1000, 0) == 0:
+                    raise RuntimeError("JSON parser worker process exited unexpectedly with exit code %s" %
+                                       processes[index].exitcode)
+
+            # Only wait for data when none of the rings had any
+            timeout_ms = 0 if records_read else 5.0 / max(1, len(active))
+    finally:
+        for reader, handler in readers:
+            reader.close()
+
+        for process in processes:
+            process.join(timeout=5)
+            if process.is_alive():
+                process.terminate()
+                process.join()
+
+        for shared_memory in shared_memories:
+            shared_memory.close()
+            shared_memory.unlink()
+
+
+class _CollectingHandler:
+    """Collects the entities an IncrementalParser completes, for the caller to pick up after each feed()"""
+
+    def __init__(self):
+        self.entities = []
+        self.error = None
+
+    def handle_dict(self, entity):
+        self.entities.append(entity)
+
+    def handle_end_stream(self):
+        pass
+
+    def handle_error(self, error_code, offset, line_no, column, fail_reason):
+        self.error = RapidJSONParseError(error_code, offset, line_no, column, fail_reason)
+
+
+class StreamingParser:
+    """Push style parser for JSON documents that arrive in chunks, i.e. from a callback based HTTP client or a
+    message consumer. feed() takes the next chunk of bytes and returns the entities it completed, close() ends the
+    document. Only the part of the document holding the entity that is not complete yet is buffered.
+
+    If a chunk holds a syntax error, feed() still returns the entities that came before it; the
+    RapidJSONParseError is then raised by the next call to feed() or close()."""
+
+    def __init__(self, transit_mapping=None, do_float_as_int=False, do_float_as_decimal=False, offset=None,
+                 limit=None):
+        self._handler = _CollectingHandler()
+        # See JSONParser
+        self._handler.offset = offset
+        self._handler.limit = limit
+        self._parser = IncrementalParser(self._handler, transit_mapping, do_float_as_int, do_float_as_decimal)
+
+    def _take_entities(self):
+        entities, self._handler.entities = self._handler.entities, []
+        if not entities and self._handler.error is not None:
+            raise self._handler.error
+        return entities
+
+    def feed(self, data):
+        if self._handler.error is None:
+            if not self._parser.feed(data):
+                self._parser.close()
+        return self._take_entities()
+
+    def close(self):
+        self._parser.close()
+        return self._take_entities()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        # Just let go of any buffered input, use close() to get the last entities and errors
+        self._parser.close()
+
+
+class AsyncJSONParser:
+    """Asynchronous iterator over the entities in a JSON document that is read from an asyncio.StreamReader (or
+    anything else with a 'read(n)' coroutine) or from an async iterable of bytes chunks, i.e. an aiohttp response's
+    'content.iter_chunked()'.
+
+    No thread is involved: the chunks are fed to a StreamingParser as they are read, on the event loop. Only the
+    part of the document holding the entity that is being read is buffered."""
+
+    def __init__(self, source, transit_mapping=None, do_float_as_int=False, do_float_as_decimal=False,
+                 chunk_size=64 * 1024):
+        self._source = source
+        self._chunks = None
+        self._chunk_size = chunk_size
+        self._parser = StreamingParser(transit_mapping, do_float_as_int, do_float_as_decimal)
+        self._entities = deque()
+        self._done = False
+
+    async def _read_chunk(self):
+        if hasattr(self._source, "read"):
+            return await self._source.read(self._chunk_size)
+
+        if self._chunks is None:
+            self._chunks = self._source.__aiter__()
+        try:
+            return await self._chunks.__anext__()
+        except StopAsyncIteration:
+            return b""
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self):
+        while not self._entities:
+            if self._done:
+                raise StopAsyncIteration
+
+            chunk = await self._read_chunk()
+            if chunk:
+                self._entities.extend(self._parser.feed(chunk))
+            else:
+                self._done = True
+                self._entities.extend(self._parser.close())
+
+        return self._entities.popleft()
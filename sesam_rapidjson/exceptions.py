@@ -66,3 +66,15 @@ class RapidJSONParseError(ValueError):
     @property
     def fail_reason(self):
         return self._fail_reason
+
+
+class RapidJSONEntityError(RapidJSONParseError):
+    """An invalid top level entity that was skipped in tolerant mode. 'raw' holds the bytes that were skipped."""
+
+    def __init__(self, error_code, offset, line_no, column, fail_reason, raw):
+        super().__init__(error_code, offset, line_no, column, fail_reason)
+        self._raw = raw
+
+    @property
+    def raw(self):
+        return self._raw
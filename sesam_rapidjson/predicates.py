@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# Copyright (C) Bouvet ASA - All Rights Reserved.
+
+import json
+import re
+
+_token_re = re.compile(r'\s*(?:(?P<op>==|!=|<=|>=|=~|<|>)|(?P<path>/[^\s"]*|[A-Za-z_$][\w$]*(?:\.[\w$]+)*))')
+_in_re = re.compile(r"\s*in\b")
+_and_re = re.compile(r"\s*and\b")
+
+_decoder = json.JSONDecoder()
+
+
+def _parse_path(path):
+    if path.startswith("/"):
+        # A JSON Pointer
+        return [token.replace("~1", "/").replace("~0", "~") for token in path[1:].split("/")]
+    return path.split(".")
+
+
+def _parse_value(expression, pos):
+    while pos < len(expression) and expression[pos].isspace():
+        pos += 1
+    try:
+        value, end = _decoder.raw_decode(expression, pos)
+    except ValueError:
+        raise ValueError("Expected a JSON value at position %s of %r" % (pos, expression)) from None
+    if isinstance(value, (dict, list)):
+        raise ValueError("Only strings, numbers, booleans and null can be compared with (position %s of %r)" %
+                         (pos, expression))
+    return value, end
+
+
+def _parse_values(expression, pos):
+    # 'in' takes a list of values in curly or square brackets
+    while pos < len(expression) and expression[pos].isspace():
+        pos += 1
+    if pos == len(expression) or expression[pos] not in "{[":
+        raise ValueError("Expected '{' or '[' after 'in' at position %s of %r" % (pos, expression))
+    closing = "}" if expression[pos] == "{" else "]"
+    pos += 1
+
+    values = []
+    while True:
+        value, pos = _parse_value(expression, pos)
+        values.append(value)
+        while pos < len(expression) and expression[pos].isspace():
+            pos += 1
+        if expression.startswith(closing, pos):
+            return values, pos + 1
+        if not expression.startswith(",", pos):
+            raise ValueError("Expected ',' or '%s' at position %s of %r" % (closing, pos, expression))
+        pos += 1
+
+
+def compile_filter(expression):
+    """Compiles a filter expression into the (path, operator, operand) tuples the native parser takes.
+
+    The expression is one or more conditions joined with 'and', such as
+
+        _deleted == false and _updated > 10 and type in {"a", "b"} and name =~ "^A"
+
+    The left side of a condition is a path to a member, either as dotted names or as a JSON Pointer. The right side
+    is a JSON string, number, boolean or null, a list of them for 'in', or a regular expression in a JSON string
+    for '=~'.
+    """
+    conditions = []
+    pos = 0
+
+    while True:
+        match = _token_re.match(expression, pos)
+        if match is None or match.group("path") is None:
+            raise ValueError("Expected a path at position %s of %r" % (pos, expression))
+        path = _parse_path(match.group("path"))
+        pos = match.end()
+
+        match = _token_re.match(expression, pos)
+        if match is not None and match.group("op") is not None:
+            op = match.group("op")
+            pos = match.end()
+            operand, pos = _parse_value(expression, pos)
+            if op == "=~" and not isinstance(operand, str):
+                raise ValueError("The operand of '=~' must be a string (%r)" % expression)
+        else:
+            in_match = _in_re.match(expression, pos)
+            if in_match is None:
+                raise ValueError("Expected an operator at position %s of %r" % (pos, expression))
+            op = "in"
+            operand, pos = _parse_values(expression, in_match.end())
+
+        conditions.append((path, op, operand))
+
+        if expression[pos:].strip() == "":
+            return conditions
+
+        and_match = _and_re.match(expression, pos)
+        if and_match is None:
+            raise ValueError("Expected 'and' at position %s of %r" % (pos, expression))
+        pos = and_match.end()
@@ -0,0 +1,14 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# Copyright (C) Bouvet ASA - All Rights Reserved.
+
+
+class RawJSON(bytes):
+    """The JSON text of an object or array that the parser did not build (see 'raw_depth' and 'raw_paths'), byte
+    for byte as it is in the input. dumps() writes it out as it is. Parse it with json.loads() or parse_string() if
+    the value is needed after all."""
+
+    __slots__ = ()
+
+    def __repr__(self):
+        return "RawJSON(%s)" % bytes.__repr__(self)
@@ -1,10 +1,17 @@
 from setuptools import setup, Extension
 from setuptools.command.build_ext import build_ext
 import sys
+import sysconfig
 import setuptools
 
 __version__ = '0.1.13'
 
+# Free-threaded python builds (python3.13t and later) need a pybind11 that knows how to run without the GIL
+if sysconfig.get_config_var("Py_GIL_DISABLED"):
+    pybind11_requirement = 'pybind11>=2.13'
+else:
+    pybind11_requirement = 'pybind11==2.2.4'
+
 
 class get_pybind_include(object):
     """Helper class to determine the pybind11 include path
@@ -105,8 +112,8 @@ setup(
     long_description='',
     packages=["sesam_rapidjson"],
     ext_modules=ext_modules,
-    setup_requires=['pybind11==2.2.4'],
-    install_requires=['pybind11==2.2.4'],
+    setup_requires=[pybind11_requirement],
+    install_requires=[pybind11_requirement],
     cmdclass={'build_ext': BuildExt},
     zip_safe=False,
 )
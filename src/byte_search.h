@@ -0,0 +1,105 @@
+#ifndef SESAM_RAPIDJSON_BYTE_SEARCH_H
+#define SESAM_RAPIDJSON_BYTE_SEARCH_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SESAM_RAPIDJSON_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// A set of byte strings to look for in raw JSON text. The search compares 16 bytes at a time against the first and
+// last byte of a pattern, and only compares the rest of the pattern where both match (the "generic SIMD" substring
+// search), which skips through text without candidates at close to memory speed. Without SSE2 it falls back to
+// memchr() on the first byte.
+class BytePatterns {
+public:
+    void add(const std::string& pattern) {
+        patterns.push_back(pattern);
+    }
+
+    bool empty() const { return patterns.empty(); }
+
+    // True if any of the patterns occurs in data[0..length)
+    bool search(const char* data, size_t length) const {
+        for (const std::string& pattern : patterns) {
+            if (find(data, length, pattern.data(), pattern.size())) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::vector<std::string> patterns;
+
+    static bool find(const char* data, size_t length, const char* pattern, size_t pattern_length) {
+        if (pattern_length == 0) {
+            return true;
+        }
+        if (pattern_length > length) {
+            return false;
+        }
+        if (pattern_length == 1) {
+            return std::memchr(data, pattern[0], length) != nullptr;
+        }
+
+        size_t i = 0;
+        // The last position the pattern can start at
+        size_t last_start = length - pattern_length;
+
+#ifdef SESAM_RAPIDJSON_SSE2
+        const __m128i first = _mm_set1_epi8(pattern[0]);
+        const __m128i last = _mm_set1_epi8(pattern[pattern_length - 1]);
+
+        for (; i + 16 <= last_start + 1; i += 16) {
+            __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + pattern_length - 1));
+            unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                                      _mm_cmpeq_epi8(block_last, last)));
+
+            while (mask != 0) {
+                size_t candidate = i + lowest_bit(mask);
+                if (std::memcmp(data + candidate + 1, pattern + 1, pattern_length - 2) == 0) {
+                    return true;
+                }
+                mask &= mask - 1;
+            }
+        }
+#endif
+
+        while (i <= last_start) {
+            const char* candidate = static_cast<const char*>(std::memchr(data + i, pattern[0], last_start - i + 1));
+            if (candidate == nullptr) {
+                return false;
+            }
+            if (std::memcmp(candidate + 1, pattern + 1, pattern_length - 1) == 0) {
+                return true;
+            }
+            i = (size_t)(candidate - data) + 1;
+        }
+
+        return false;
+    }
+
+#ifdef SESAM_RAPIDJSON_SSE2
+    static unsigned lowest_bit(unsigned mask) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (unsigned)index;
+#else
+        return (unsigned)__builtin_ctz(mask);
+#endif
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef SESAM_RAPIDJSON_ENTITY_FILTER_H
+#define SESAM_RAPIDJSON_ENTITY_FILTER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rapidjson/internal/regex.h"
+
+#include "field_projection.h"
+
+// A scalar value of a document, or an operand of a condition. Strings are not copied.
+struct FilterValue {
+    enum Type {
+        NULL_VALUE,
+        BOOL,
+        INTEGER,    // Fits in an int64_t
+        NUMBER,     // Any other number, as a double
+        STRING
+    };
+
+    Type type;
+    bool boolean;
+    int64_t integer;
+    double number;
+    const char* string;
+    size_t length;
+
+    FilterValue() : type(NULL_VALUE), boolean(false), integer(0), number(0), string(nullptr), length(0) {}
+
+    static FilterValue from_bool(bool value) {
+        FilterValue result;
+        result.type = BOOL;
+        result.boolean = value;
+        return result;
+    }
+
+    static FilterValue from_int(int64_t value) {
+        FilterValue result;
+        result.type = INTEGER;
+        result.integer = value;
+        result.number = (double)value;
+        return result;
+    }
+
+    static FilterValue from_uint(uint64_t value) {
+        if (value <= (uint64_t)INT64_MAX) {
+            return from_int((int64_t)value);
+        }
+        return from_double((double)value);
+    }
+
+    static FilterValue from_double(double value) {
+        FilterValue result;
+        result.type = NUMBER;
+        result.number = value;
+        return result;
+    }
+
+    // A number as written in the document
+    static FilterValue from_raw_number(const char* str, size_t length) {
+        if (length < 19 && std::strpbrk(str, ".eE") == nullptr) {
+            return from_int(std::strtoll(str, nullptr, 10));
+        }
+        return from_double(std::strtod(str, nullptr));
+    }
+
+    static FilterValue from_string(const char* str, size_t length) {
+        FilterValue result;
+        result.type = STRING;
+        result.string = str;
+        result.length = length;
+        return result;
+    }
+};
+
+// Conditions on the scalar values of an entity, found by their paths (lists of member names). The entity passes if
+// all of the conditions hold. A condition doesn't hold if its value is missing, is an object or array, or is of
+// another type than the operand (except for '!=', which holds for values of other types).
+//
+// The paths are kept in a PointerSelection, where each condition has the slot with its index.
+class EntityFilter {
+public:
+    enum Op { EQ, NE, LT, LE, GT, GE, IN, MATCH };
+
+    // Adds a condition that compares the value with the operands: one for the comparisons, any number for IN
+    void add(const std::vector<std::string>& path, Op op, const std::vector<FilterValue>& operands) {
+        Condition condition;
+        condition.op = op;
+
+        // Keep copies of the strings of the operands. Moving the vector of strings around doesn't move the strings.
+        for (const FilterValue& operand : operands) {
+            condition.strings.push_back(std::string(operand.string != nullptr ? operand.string : "", operand.length));
+            condition.operands.push_back(operand);
+        }
+        for (size_t i = 0; i < condition.operands.size(); i++) {
+            condition.operands[i].string = condition.strings[i].c_str();
+        }
+
+        conditions.push_back(std::move(condition));
+        selection.add(path);
+    }
+
+    // Adds a condition that holds for strings matching a regular expression (the subset of ECMAScript supported by
+    // rapidjson's GenericRegex). Returns false if the pattern is invalid.
+    bool add_match(const std::vector<std::string>& path, const std::string& pattern) {
+        Condition condition;
+        condition.op = MATCH;
+        condition.regex.reset(new Regex(pattern.c_str()));
+
+        if (!condition.regex->IsValid()) {
+            return false;
+        }
+
+        condition.search.reset(new RegexSearch(*condition.regex));
+        conditions.push_back(std::move(condition));
+        selection.add(path);
+        return true;
+    }
+
+    size_t size() const { return conditions.size(); }
+
+    const PointerSelection& paths() const { return selection; }
+
+    // Tests the value found at the path of condition 'index'
+    bool test(size_t index, const FilterValue& value) {
+        Condition& condition = conditions[index];
+
+        switch (condition.op) {
+            case EQ:
+                return compare(value, condition.operands[0]) == 0;
+            case NE:
+                return compare(value, condition.operands[0]) != 0;
+            case LT:
+                return compare(value, condition.operands[0]) == -1;
+            case LE: {
+                int result = compare(value, condition.operands[0]);
+                return result == -1 || result == 0;
+            }
+            case GT:
+                return compare(value, condition.operands[0]) == 1;
+            case GE: {
+                int result = compare(value, condition.operands[0]);
+                return result == 1 || result == 0;
+            }
+            case IN:
+                for (const FilterValue& operand : condition.operands) {
+                    if (compare(value, operand) == 0) {
+                        return true;
+                    }
+                }
+                return false;
+            case MATCH:
+                // The strings from the reader are null terminated
+                return value.type == FilterValue::STRING && condition.search->Search(value.string);
+        }
+
+        return false;
+    }
+
+private:
+    typedef rapidjson::internal::GenericRegex<rapidjson::UTF8<> > Regex;
+    typedef rapidjson::internal::GenericRegexSearch<Regex> RegexSearch;
+
+    struct Condition {
+        Op op;
+        std::vector<FilterValue> operands;
+        std::vector<std::string> strings;
+        std::unique_ptr<Regex> regex;
+        std::unique_ptr<RegexSearch> search;
+    };
+
+    std::vector<Condition> conditions;
+    PointerSelection selection;
+
+    // Returns -1, 0 or 1 as 'a' is less than, equal to or greater than 'b', or 2 if they can't be compared
+    static int compare(const FilterValue& a, const FilterValue& b) {
+        bool a_number = a.type == FilterValue::INTEGER || a.type == FilterValue::NUMBER;
+        bool b_number = b.type == FilterValue::INTEGER || b.type == FilterValue::NUMBER;
+
+        if (a_number && b_number) {
+            if (a.type == FilterValue::INTEGER && b.type == FilterValue::INTEGER) {
+                return a.integer < b.integer ? -1 : (a.integer > b.integer ? 1 : 0);
+            }
+            if (a.number != a.number || b.number != b.number) {
+                return 2;
+            }
+            return a.number < b.number ? -1 : (a.number > b.number ? 1 : 0);
+        }
+
+        if (a.type != b.type) {
+            return 2;
+        }
+
+        switch (a.type) {
+            case FilterValue::NULL_VALUE:
+                return 0;
+            case FilterValue::BOOL:
+                return (int)a.boolean - (int)b.boolean;
+            case FilterValue::STRING: {
+                int result = std::memcmp(a.string, b.string, a.length < b.length ? a.length : b.length);
+                if (result == 0) {
+                    return a.length < b.length ? -1 : (a.length > b.length ? 1 : 0);
+                }
+                return result < 0 ? -1 : 1;
+            }
+            default:
+                return 2;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,350 @@
+#ifndef SESAM_RAPIDJSON_ENTITY_SCANNER_H
+#define SESAM_RAPIDJSON_ENTITY_SCANNER_H
+
+#include <cstddef>
+
+#include "rapidjson/error/error.h"
+
+// Finds the boundaries of the top level entities in a JSON document without tokenizing it: it only keeps track of
+// strings and of the nesting of brackets. The document is either an array of entities or a single value (which
+// is then the only entity). The bytes can be fed in chunks of any size.
+//
+// The scanner checks the syntax between the entities (commas, the brackets of the top level array and trailing
+// garbage). The entities themselves are not validated; that is left to whoever parses them. After an error in a
+// top level array, resync() makes the scanner skip ahead to the next object.
+class EntityScanner {
+public:
+    enum Result {
+        NEED_MORE,   // All the given bytes were scanned without completing an entity
+        ENTITY,      // An entity ended
+        ERROR,       // Invalid syntax between the entities, see the error_* members
+        INCOMPLETE,  // (finish() only) the input ended in the middle of an entity
+        DONE         // (finish() only) the input ended cleanly
+    };
+
+    // Where the current (or last) entity started
+    size_t entity_offset;
+    size_t entity_line;
+    size_t entity_column;
+    // The first byte of the current (or last) entity, i.e. '{' for objects
+    char entity_kind;
+    // Number of entities completed so far, and how many of them are objects (the ones the parsers emit)
+    size_t entity_count;
+    size_t object_count;
+
+    rapidjson::ParseErrorCode error_code;
+    size_t error_offset;
+    size_t error_line;
+    size_t error_column;
+
+    EntityScanner() {
+        reset();
+    }
+
+    void reset() {
+        phase = BEFORE_ROOT;
+        root_is_array = false;
+        depth = 0;
+        in_string = false;
+        escaped = false;
+        position = 0;
+        line = 1;
+        line_start = 0;
+        entity_offset = 0;
+        entity_line = 1;
+        entity_column = 1;
+        entity_kind = 0;
+        entity_count = 0;
+        object_count = 0;
+        error_code = rapidjson::kParseErrorNone;
+        error_offset = 0;
+        error_line = 0;
+        error_column = 0;
+    }
+
+    bool in_entity() const { return phase == IN_ENTITY; }
+    bool is_resyncing() const { return phase == RESYNC; }
+    bool is_root_array() const { return root_is_array; }
+
+    // Total number of bytes scanned
+    size_t offset() const { return position; }
+    size_t current_line() const { return line; }
+    size_t current_column() const { return position - line_start + 1; }
+
+    // Scans the bytes in 'data' until an entity ends (ENTITY), a syntax error is found (ERROR) or all bytes have
+    // been scanned (NEED_MORE). 'consumed' is set to the number of bytes scanned, which for ENTITY includes the
+    // last byte of the entity. If an entity started in this call, 'entity_start' is set to the index of its first
+    // byte in 'data', otherwise it is set to 0.
+    Result scan(const char* data, size_t length, size_t& consumed, size_t& entity_start) {
+        size_t i = 0;
+        entity_start = 0;
+
+        while (i < length) {
+            if (phase == IN_ENTITY) {
+                if (scan_entity(data, length, i)) {
+                    consumed = i;
+                    return ENTITY;
+                }
+                continue;
+            }
+
+            char c = data[i];
+
+            if (is_whitespace(c)) {
+                advance(c);
+                i++;
+                continue;
+            }
+
+            switch (phase) {
+                case BEFORE_ROOT:
+                    if (c == '[') {
+                        root_is_array = true;
+                        phase = ARRAY_START;
+                        advance(c);
+                        i++;
+                        continue;
+                    }
+                    break;
+                case ARRAY_START:
+                    if (c == ']') {
+                        phase = AFTER_ROOT;
+                        advance(c);
+                        i++;
+                        continue;
+                    }
+                    break;
+                case ARRAY_NEXT:
+                    if (c == ']' || c == ',') {
+                        return fail(rapidjson::kParseErrorValueInvalid, i, consumed);
+                    }
+                    break;
+                case ARRAY_AFTER_VALUE:
+                    if (c == ',') {
+                        phase = ARRAY_NEXT;
+                    } else if (c == ']') {
+                        phase = AFTER_ROOT;
+                    } else {
+                        return fail(rapidjson::kParseErrorArrayMissCommaOrSquareBracket, i, consumed);
+                    }
+                    advance(c);
+                    i++;
+                    continue;
+                case AFTER_ROOT:
+                    return fail(rapidjson::kParseErrorDocumentRootNotSingular, i, consumed);
+                case RESYNC:
+                    if (c == '{') {
+                        phase = ARRAY_NEXT;
+                        consumed = i;
+                        return NEED_MORE;
+                    }
+                    if (c == ']') {
+                        phase = ARRAY_AFTER_VALUE;
+                        consumed = i;
+                        return NEED_MORE;
+                    }
+                    advance(c);
+                    i++;
+                    continue;
+                default:
+                    break;
+            }
+
+            // Start of an entity
+            if (c == ',' || c == ']' || c == '}' || c == ':') {
+                return fail(rapidjson::kParseErrorValueInvalid, i, consumed);
+            }
+
+            phase = IN_ENTITY;
+            entity_kind = c;
+            entity_offset = position;
+            entity_line = line;
+            entity_column = current_column();
+            entity_start = i;
+            depth = 0;
+            in_string = false;
+            escaped = false;
+        }
+
+        consumed = i;
+        return NEED_MORE;
+    }
+
+    // Recovers from an error in a top level array: the scanner skips everything up to the next '{' (which starts
+    // the next entity) or ']' (which ends the array). scan() returns NEED_MORE as soon as it is done skipping, so
+    // the caller can tell which bytes were skipped. Returns false if the document can't be resynced.
+    bool resync() {
+        if (!root_is_array || phase == AFTER_ROOT) {
+            return false;
+        }
+
+        phase = RESYNC;
+        in_string = false;
+        escaped = false;
+        return true;
+    }
+
+    // Tells the scanner there is no more input
+    Result finish() {
+        switch (phase) {
+            case BEFORE_ROOT:
+                error_code = rapidjson::kParseErrorDocumentEmpty;
+                break;
+            case ARRAY_START:
+            case ARRAY_NEXT:
+                error_code = rapidjson::kParseErrorValueInvalid;
+                break;
+            case ARRAY_AFTER_VALUE:
+            case RESYNC:
+                error_code = rapidjson::kParseErrorArrayMissCommaOrSquareBracket;
+                break;
+            case IN_ENTITY:
+                if (is_scalar_kind() && !in_string) {
+                    // Numbers and literals are only ended by what comes after them
+                    end_entity();
+                    return ENTITY;
+                }
+                return INCOMPLETE;
+            case AFTER_ROOT:
+                return DONE;
+        }
+
+        error_offset = position;
+        error_line = line;
+        error_column = current_column();
+        return ERROR;
+    }
+
+private:
+    enum Phase {
+        BEFORE_ROOT,
+        ARRAY_START,        // After the '[' of the top level array
+        ARRAY_NEXT,         // After a ',' in the top level array
+        ARRAY_AFTER_VALUE,  // After an entity in the top level array
+        IN_ENTITY,
+        AFTER_ROOT,
+        RESYNC              // Skipping to the next entity after an error
+    };
+
+    Phase phase;
+    bool root_is_array;
+    int depth;
+    bool in_string;
+    bool escaped;
+    size_t position;
+    size_t line;
+    size_t line_start;
+
+    static bool is_whitespace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    bool is_scalar_kind() const {
+        return entity_kind != '{' && entity_kind != '[' && entity_kind != '"';
+    }
+
+    void advance(char c) {
+        position++;
+        if (c == '\n') {
+            line++;
+            line_start = position;
+        }
+    }
+
+    Result fail(rapidjson::ParseErrorCode code, size_t i, size_t& consumed) {
+        error_code = code;
+        error_offset = position;
+        error_line = line;
+        error_column = current_column();
+        consumed = i;
+        return ERROR;
+    }
+
+    void end_entity() {
+        phase = root_is_array ? ARRAY_AFTER_VALUE : AFTER_ROOT;
+        entity_count++;
+        if (entity_kind == '{') {
+            object_count++;
+        }
+    }
+
+    // Scans entity bytes from data[i]. Returns true (with 'i' just past the last byte) if the entity ended.
+    bool scan_entity(const char* data, size_t length, size_t& i) {
+        if (is_scalar_kind()) {
+            while (i < length) {
+                char c = data[i];
+                if (is_whitespace(c) || c == ',' || c == ']' || c == '}') {
+                    // The delimiter belongs to whatever comes next
+                    end_entity();
+                    return true;
+                }
+                position++;
+                i++;
+            }
+            return false;
+        }
+
+        while (i < length) {
+            char c = data[i];
+
+            if (in_string) {
+                // Strings can't hold raw newlines, so there are no lines to count in here
+                size_t start = i;
+                while (i < length) {
+                    c = data[i];
+                    if (escaped) {
+                        escaped = false;
+                    } else if (c == '\\') {
+                        escaped = true;
+                    } else if (c == '"') {
+                        break;
+                    }
+                    i++;
+                }
+                position += i - start;
+
+                if (i == length) {
+                    return false;
+                }
+
+                in_string = false;
+                position++;
+                i++;
+
+                if (depth == 0) {
+                    // The entity was a plain string
+                    end_entity();
+                    return true;
+                }
+                continue;
+            }
+
+            advance(c);
+            i++;
+
+            switch (c) {
+                case '"':
+                    in_string = true;
+                    break;
+                case '{':
+                case '[':
+                    depth++;
+                    break;
+                case '}':
+                case ']':
+                    depth--;
+                    if (depth <= 0) {
+                        end_entity();
+                        return true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef SESAM_RAPIDJSON_FIELD_PROJECTION_H
+#define SESAM_RAPIDJSON_FIELD_PROJECTION_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The members to keep of each entity, as a tree of member names built from a list of paths. Node 0 is the entity
+// itself; each node maps the names of the selected members to their own node, or to WHOLE if the member is kept
+// as it is. Arrays share the node of the member they are the value of, so a path selects from every element.
+class FieldProjection {
+public:
+    static const int WHOLE = -1;  // The value is kept as it is
+    static const int NONE = -2;   // The value is left out
+
+    FieldProjection() : nodes(1) {}
+
+    // Selects the value at 'path', a list of member names starting at the entity. Selecting a value also selects
+    // everything in it, whatever else has been selected below it.
+    void add(const std::vector<std::string>& path) {
+        int node = 0;
+
+        for (size_t i = 0; i < path.size(); i++) {
+            std::unordered_map<std::string, int>::iterator it = nodes[node].find(path[i]);
+
+            if (i == path.size() - 1) {
+                nodes[node][path[i]] = WHOLE;
+            } else if (it == nodes[node].end()) {
+                int child = (int)nodes.size();
+                nodes[node][path[i]] = child;
+                nodes.push_back(std::unordered_map<std::string, int>());
+                node = child;
+            } else if (it->second == WHOLE) {
+                return;
+            } else {
+                node = it->second;
+            }
+        }
+    }
+
+    // Returns the node of member 'name' of 'node', WHOLE or NONE
+    int find(int node, const char* name, size_t length) const {
+        const std::unordered_map<std::string, int>& members = nodes[node];
+        std::unordered_map<std::string, int>::const_iterator it = members.find(std::string(name, length));
+        return it == members.end() ? NONE : it->second;
+    }
+
+private:
+    std::vector<std::unordered_map<std::string, int> > nodes;
+};
+
+// The values to extract from each entity, compiled from a list of JSON Pointers (RFC 6901) into a tree of their
+// reference tokens. Node 0 is the entity. A token matches the object member with that name or, if it is a number,
+// the array element with that index. Each node lists the slots of the pointers that end at it.
+class PointerSelection {
+public:
+    static const int NONE = -1;
+
+    PointerSelection() : nodes(1), slot_count(0) {}
+
+    // Number of pointers, and so of slots
+    size_t size() const { return slot_count; }
+
+    // Adds a pointer given by its (unescaped) reference tokens and returns its slot
+    int add(const std::vector<std::string>& tokens) {
+        int node = 0;
+
+        for (size_t i = 0; i < tokens.size(); i++) {
+            std::unordered_map<std::string, int>::iterator it = nodes[node].children.find(tokens[i]);
+
+            if (it == nodes[node].children.end()) {
+                int child = (int)nodes.size();
+                nodes[node].children[tokens[i]] = child;
+                nodes.push_back(Node());
+                node = child;
+            } else {
+                node = it->second;
+            }
+        }
+
+        nodes[node].slots.push_back((int)slot_count);
+        return (int)slot_count++;
+    }
+
+    // Returns the node of member 'name' of 'node', or NONE
+    int find(int node, const char* name, size_t length) const {
+        const std::unordered_map<std::string, int>& children = nodes[node].children;
+        std::unordered_map<std::string, int>::const_iterator it = children.find(std::string(name, length));
+        return it == children.end() ? NONE : it->second;
+    }
+
+    // Returns the node of element 'index' of 'node', or NONE
+    int find(int node, size_t index) const {
+        if (nodes[node].children.empty()) {
+            return NONE;
+        }
+
+        std::string name = std::to_string(index);
+        return find(node, name.data(), name.size());
+    }
+
+    // True if the node has children, i.e. something inside its value is extracted
+    bool has_children(int node) const { return !nodes[node].children.empty(); }
+
+    const std::vector<int>& slots(int node) const { return nodes[node].slots; }
+
+private:
+    struct Node {
+        std::unordered_map<std::string, int> children;
+        std::vector<int> slots;
+    };
+
+    std::vector<Node> nodes;
+    size_t slot_count;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef SESAM_RAPIDJSON_ITEM_PATH_H
+#define SESAM_RAPIDJSON_ITEM_PATH_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "rapidjson/reader.h"
+
+// Picks the values at an ijson style prefix out of a document and hands them to another handler as if they were the
+// elements of a top level array, so the entities can be nested anywhere in the document. The prefix is a list of
+// member names, with "item" for the elements of an array: "data.items.item" are the elements of the array at
+// data.items. Everything else in the document is skipped without being handed over.
+//
+// In key/value mode the prefix names an object instead, and each of its members is an item. The inner handler's
+// set_item_key() is called with the member name before its value is handed over.
+template <typename Handler>
+class ItemPathHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, ItemPathHandler<Handler> > {
+public:
+    typedef rapidjson::SizeType SizeType;
+
+    ItemPathHandler(Handler& handler, const std::vector<std::string>& path, bool key_value, size_t offset)
+            : handler(handler), path(path), key_value(key_value), offset(offset), item_count(0), depth(0),
+              matched(0), key_matched(false), item_depth(0), forwarding(false) {
+        if (key_value) {
+            // The members of the object at the prefix
+            this->path.push_back(std::string());
+        }
+    }
+
+    bool Null() { return start_scalar() ? handler.Null() && end_scalar() : end_scalar(); }
+    bool Bool(bool value) { return start_scalar() ? handler.Bool(value) && end_scalar() : end_scalar(); }
+    bool Int(int value) { return start_scalar() ? handler.Int(value) && end_scalar() : end_scalar(); }
+    bool Uint(unsigned value) { return start_scalar() ? handler.Uint(value) && end_scalar() : end_scalar(); }
+    bool Int64(int64_t value) { return start_scalar() ? handler.Int64(value) && end_scalar() : end_scalar(); }
+    bool Uint64(uint64_t value) { return start_scalar() ? handler.Uint64(value) && end_scalar() : end_scalar(); }
+    bool Double(double value) { return start_scalar() ? handler.Double(value) && end_scalar() : end_scalar(); }
+
+    bool RawNumber(const char* str, SizeType length, bool copy) {
+        return start_scalar() ? handler.RawNumber(str, length, copy) && end_scalar() : end_scalar();
+    }
+
+    bool String(const char* str, SizeType length, bool copy) {
+        return start_scalar() ? handler.String(str, length, copy) && end_scalar() : end_scalar();
+    }
+
+    bool Key(const char* str, SizeType length, bool copy) {
+        if (forwarding) {
+            return handler.Key(str, length, copy);
+        }
+
+        if (matched == depth && depth <= path.size()) {
+            // A member of an object on the prefix
+            const std::string& name = path[depth - 1];
+            key_matched = (key_value && depth == path.size()) ||
+                    (name.size() == length && std::memcmp(name.data(), str, length) == 0);
+
+            if (key_matched && key_value && depth == path.size()) {
+                key.assign(str, length);
+            }
+        }
+        return true;
+    }
+
+    bool StartObject() { return start_container(false); }
+    bool StartArray() { return start_container(true); }
+    bool EndObject(SizeType count) { return end_container(false, count); }
+    bool EndArray(SizeType count) { return end_container(true, count); }
+
+private:
+    Handler& handler;
+    std::vector<std::string> path;
+    bool key_value;
+    // Number of items to skip
+    size_t offset;
+    size_t item_count;
+
+    // Number of open containers
+    size_t depth;
+    // Number of open containers on the prefix, from the outermost
+    size_t matched;
+    // Whether each of the open containers on the prefix is an array
+    std::vector<bool> matched_is_array;
+    // The last key matched the prefix
+    bool key_matched;
+    // The name of the member that is the current item, in key/value mode
+    std::string key;
+    // The depth the current item started at
+    size_t item_depth;
+    bool forwarding;
+
+    // Works out if the value that starts now is on the prefix
+    bool on_path() {
+        if (matched != depth || depth > path.size()) {
+            return false;
+        }
+
+        if (depth == 0) {
+            return true;
+        }
+
+        if (matched_is_array[depth - 1]) {
+            // The elements of an array are "item", but they are never members in key/value mode
+            return !(key_value && depth == path.size()) && path[depth - 1] == "item";
+        }
+
+        bool result = key_matched;
+        key_matched = false;
+        return result;
+    }
+
+    // Returns true if the value that starts now is an item that is handed over. Sets 'on_prefix' if the value is
+    // on the prefix, i.e. is an item or a container that may hold items.
+    bool start_item(bool& on_prefix) {
+        if (depth == 0) {
+            // The start of the document: the items go into a top level array
+            handler.StartArray();
+        }
+
+        on_prefix = on_path();
+
+        if (!on_prefix || depth < path.size() || item_count++ < offset) {
+            return false;
+        }
+
+        if (key_value) {
+            handler.set_item_key(key.data(), key.size());
+        }
+        return true;
+    }
+
+    bool start_scalar() {
+        bool on_prefix;
+        return forwarding || start_item(on_prefix);
+    }
+
+    bool end_scalar() {
+        if (depth == 0) {
+            // The document was a scalar
+            handler.EndArray(0);
+        }
+        return true;
+    }
+
+    bool start_container(bool is_array) {
+        bool on_prefix;
+
+        if (forwarding || start_item(on_prefix)) {
+            if (!forwarding) {
+                forwarding = true;
+                item_depth = depth;
+            }
+            depth++;
+            return is_array ? handler.StartArray() : handler.StartObject();
+        }
+
+        if (on_prefix && depth < path.size()) {
+            matched++;
+            matched_is_array.push_back(is_array);
+        }
+        depth++;
+        return true;
+    }
+
+    bool end_container(bool is_array, SizeType count) {
+        depth--;
+
+        if (forwarding) {
+            if (depth == item_depth) {
+                forwarding = false;
+            }
+
+            if (!(is_array ? handler.EndArray(count) : handler.EndObject(count))) {
+                return false;
+            }
+        } else if (matched > depth) {
+            matched--;
+            matched_is_array.pop_back();
+        }
+
+        if (depth == 0) {
+            handler.EndArray(0);
+        }
+        return true;
+    }
+};
+
+#endif
@@ -2,18 +2,40 @@
 #include <pybind11/stl.h>
 #include <iostream>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 #include <cerrno>
 #include <limits>
+#include <cmath>
 #include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
 
 #include "date.h"
+#include "thread_pool.h"
+#include "shared_ring.h"
+#include "entity_scanner.h"
+#include "field_projection.h"
+#include "entity_filter.h"
+#include "byte_search.h"
+#include "item_path.h"
+#include "raw_json.h"
+#include "utf8.h"
+#include "number_token.h"
+#include "float_parse.h"
+#include "uint128.h"
 
 #include "rapidjson/filereadstream.h"
+#include "rapidjson/pointer.h"
 #include "rapidjson/reader.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
 
 #define BUFFER_SIZE 1048576
 
@@ -106,6 +128,160 @@ std::shared_ptr<PyObject> make_decref_python_ptr(PyObject* py_object) {
   });
 }
 
+// Python objects the parsers look up in other modules. They are cached per thread, which keeps the lookups (and
+// the import lock) off the hot path without any locking on free-threaded python builds. The references are never
+// released, as thread_local destructors run after the thread has let go of its python thread state.
+struct PerThreadState {
+    PyObject* decimal_type;
+};
+
+static thread_local PerThreadState per_thread_state = {nullptr};
+
+py::object get_decimal_type() {
+    if (per_thread_state.decimal_type == nullptr) {
+        per_thread_state.decimal_type = py::module::import("decimal").attr("Decimal").cast<py::object>().release().ptr();
+    }
+
+    return py::reinterpret_borrow<py::object>(per_thread_state.decimal_type);
+}
+
+// Makes a python str of UTF-8 text. ASCII text, which is most of it, is found with one quick scan and copied
+// straight into a new str. Other text goes to python's decoder, which does better than a scan and decode of our own
+// once there are more than a few characters that are not ASCII (see examples/string_bench.py). Either way there is
+// no strlen() and no copy into a std::string first. Raises UnicodeDecodeError for text that is not valid UTF-8.
+py::object make_str(const char* str, size_t length) {
+    PyObject* result;
+
+    if (utf8_ascii_length(str, length) == length) {
+        result = PyUnicode_New((Py_ssize_t)length, 0x7F);
+        if (result != nullptr) {
+            std::memcpy(PyUnicode_1BYTE_DATA(result), str, length);
+        }
+    } else {
+        result = PyUnicode_DecodeUTF8(str, (Py_ssize_t)length, "strict");
+    }
+
+    if (result == nullptr) {
+        throw py::error_already_set();
+    }
+    return py::reinterpret_steal<py::object>(result);
+}
+
+// Makes a python int of a sign and decimal digits without leading zeros. Up to 19 digits are converted natively,
+// longer ones by python.
+py::object make_int(bool negative, const char* digits, size_t length) {
+    const uint64_t min_int64_magnitude = (uint64_t)1 << 63;
+    uint64_t magnitude;
+    PyObject* result;
+
+    if (NumberToken::digits_to_uint64(digits, length, magnitude) && (!negative || magnitude <= min_int64_magnitude)) {
+        if (!negative) {
+            result = PyLong_FromUnsignedLongLong(magnitude);
+        } else if (magnitude == min_int64_magnitude) {
+            result = PyLong_FromLongLong(std::numeric_limits<long long>::min());
+        } else {
+            result = PyLong_FromLongLong(-(long long)magnitude);
+        }
+    } else {
+        std::string text;
+        if (negative) {
+            text.push_back('-');
+        }
+        text.append(digits, length);
+        result = PyLong_FromString(text.c_str(), nullptr, 10);
+    }
+
+    if (result == nullptr) {
+        throw py::error_already_set();
+    }
+    return py::reinterpret_steal<py::object>(result);
+}
+
+// Makes Decimals of number literals. Monetary values repeat a lot (0.00, 1.00, 100.00), so the Decimals of the
+// recent short literals are kept in a small direct mapped cache and handed out again, which is safe as Decimals are
+// immutable. Other literals are passed to the constructor with vectorcall, without building an argument tuple.
+class DecimalFactory {
+public:
+    explicit DecimalFactory(py::object decimal_type) : decimal_type(decimal_type) {}
+
+    py::object make(const char* str, size_t length) {
+        if (length > MAX_LITERAL) {
+            return construct(str, length);
+        }
+
+        if (cache.empty()) {
+            cache.resize(CACHE_SIZE);
+        }
+
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+        }
+
+        Entry& entry = cache[hash & (CACHE_SIZE - 1)];
+        if (entry.value && entry.length == length && std::memcmp(entry.literal, str, length) == 0) {
+            return entry.value;
+        }
+
+        py::object value = construct(str, length);
+        entry.length = (unsigned char)length;
+        std::memcpy(entry.literal, str, length);
+        entry.value = value;
+        return value;
+    }
+
+    const py::object& type() const { return decimal_type; }
+
+private:
+    static const size_t CACHE_SIZE = 256;
+    static const size_t MAX_LITERAL = 24;
+
+    struct Entry {
+        unsigned char length;
+        char literal[MAX_LITERAL];
+        py::object value;
+    };
+
+    py::object decimal_type;
+    std::vector<Entry> cache;
+
+    py::object construct(const char* str, size_t length) {
+        PyObject* text = PyUnicode_FromStringAndSize(str, (Py_ssize_t)length);
+        if (text == nullptr) {
+            throw py::error_already_set();
+        }
+
+#if PY_VERSION_HEX >= 0x03090000
+        // The slot before the argument may be used by the callee
+        PyObject* args[2] = {nullptr, text};
+        PyObject* result = PyObject_Vectorcall(decimal_type.ptr(), args + 1, 1 | PY_VECTORCALL_ARGUMENTS_OFFSET,
+                                               nullptr);
+#else
+        PyObject* result = PyObject_CallFunctionObjArgs(decimal_type.ptr(), text, nullptr);
+#endif
+        Py_DECREF(text);
+
+        if (result == nullptr) {
+            throw py::error_already_set();
+        }
+        return py::reinterpret_steal<py::object>(result);
+    }
+};
+
+// Flag a consumer sets to make a parse running in another thread stop. The parse functions check it between
+// parse steps, so a cancelled parse stops reading right away and frees its buffers.
+class CancelToken {
+private:
+    std::atomic<bool> cancelled;
+
+public:
+    CancelToken() : cancelled(false) {}
+
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool is_cancelled() const { return cancelled.load(std::memory_order_relaxed); }
+};
+
 py::int_ parse8601(const std::string &date_str)
 {
     using namespace date;
@@ -168,10 +344,23 @@ private:
     StreamWrapper(const StreamWrapper&);
     StreamWrapper& operator=(const StreamWrapper&);
 
+    void read_buffer() {
+        if (gil_released) {
+            GILHolder gil_holder;
+            buffer = py_io_read(BUFFER_SIZE).cast<std::string>();
+        } else {
+            buffer = py_io_read(BUFFER_SIZE).cast<std::string>();
+        }
+        buffer_cursor = 0;
+    }
+
 public:
     typedef char Ch;
+    // Set when the parse runs with the GIL released; it is then only taken while reading from the stream
+    bool gil_released;
 
     StreamWrapper(py::object py_io_stream) : py_io_stream(py_io_stream) {
+        gil_released = false;
         cursor = 0;
         py_io_read = py_io_stream.attr("read");
 
@@ -185,8 +374,7 @@ public:
     Ch Peek() { // 1
         if (buffer.empty() || buffer_cursor >= buffer.length()) {
             // Get new buffer from stream
-            buffer = py_io_read(BUFFER_SIZE).cast<std::string>();
-            buffer_cursor = 0;
+            read_buffer();
 
             // cout << "Peek(): New buffer loaded!" << endl;
         }
@@ -204,8 +392,7 @@ public:
     Ch Take() { // 2
         if (buffer.empty() || buffer_cursor >= buffer.length()) {
             // Get new buffer from stream
-            buffer = py_io_read(BUFFER_SIZE).cast<std::string>();
-            buffer_cursor = 0;
+            read_buffer();
 
             // cout << "Take(): New buffer loaded!" << endl;
         }
@@ -236,6 +423,25 @@ public:
         return result;
     }
 
+    // Bulk access for skipping without parsing: the unread part of the buffer, which is refilled first if it is
+    // empty. 'available' is 0 at the end of the stream.
+    const Ch* PeekBuffer(size_t& available) {
+        if (buffer_cursor >= buffer.length()) {
+            read_buffer();
+        }
+
+        available = buffer.length() - buffer_cursor;
+        return buffer.data() + buffer_cursor;
+    }
+
+    // Moves past 'count' bytes returned by PeekBuffer(), which leaves the stream at the given line and column
+    void Advance(size_t count, size_t line, size_t column) {
+        buffer_cursor += count;
+        cursor += count;
+        this->line_number = line - 1;
+        this->column = column - 1;
+    }
+
     size_t Tell() const { return cursor; } // 3
 
     size_t GetLine() const { return line_number+1; }
@@ -356,6 +562,264 @@ public:
 };
 
 
+// Stream wrapper that reads JSON directly from a file on disk. If the calling thread holds the python GIL (as
+// indicated by 'holding_gil') it is released while waiting for the disk, so other threads can run python code.
+class FileStreamWrapper {
+private:
+    std::FILE* fp;
+    size_t cursor;
+    size_t buffer_cursor;
+    size_t buffer_length;
+    size_t line_number;
+    size_t column;
+    bool eof;
+    std::vector<char> buffer;
+
+    FileStreamWrapper(const FileStreamWrapper&);
+    FileStreamWrapper& operator=(const FileStreamWrapper&);
+
+    void fill_buffer() {
+        if (eof) {
+            return;
+        }
+
+        if (holding_gil) {
+            GILReleaser gil_releaser;
+            buffer_length = std::fread(buffer.data(), 1, buffer.size(), fp);
+        } else {
+            buffer_length = std::fread(buffer.data(), 1, buffer.size(), fp);
+        }
+
+        buffer_cursor = 0;
+        eof = buffer_length == 0;
+    }
+
+public:
+    typedef char Ch;
+    bool holding_gil;
+    int open_errno;
+
+    FileStreamWrapper(const std::string& path) : buffer(BUFFER_SIZE) {
+        cursor = 0;
+        buffer_cursor = 0;
+        buffer_length = 0;
+        line_number = 0;
+        column = 0;
+        holding_gil = false;
+
+        fp = std::fopen(path.c_str(), "rb");
+        open_errno = (fp == nullptr) ? errno : 0;
+        eof = fp == nullptr;
+    }
+
+    ~FileStreamWrapper() {
+        if (fp != nullptr) {
+            std::fclose(fp);
+        }
+    }
+
+    bool is_open() const { return fp != nullptr; }
+
+    Ch Peek() {
+        if (buffer_cursor >= buffer_length) {
+            fill_buffer();
+        }
+
+        if (eof) {
+            return '\0';
+        }
+
+        return buffer[buffer_cursor];
+    }
+
+    Ch Take() {
+        if (buffer_cursor >= buffer_length) {
+            fill_buffer();
+        }
+
+        if (eof) {
+            return '\0';
+        }
+
+        Ch result = buffer[buffer_cursor++];
+        cursor++;
+
+        if (result == '\n') {
+            line_number++;
+            column = 0;
+        }
+        else {
+            column++;
+        }
+
+        return result;
+    }
+
+    // Bulk access for skipping without parsing, see StreamWrapper
+    const Ch* PeekBuffer(size_t& available) {
+        if (buffer_cursor >= buffer_length) {
+            fill_buffer();
+        }
+
+        available = eof ? 0 : buffer_length - buffer_cursor;
+        return buffer.data() + buffer_cursor;
+    }
+
+    void Advance(size_t count, size_t line, size_t column) {
+        buffer_cursor += count;
+        cursor += count;
+        this->line_number = line - 1;
+        this->column = column - 1;
+    }
+
+    size_t Tell() const { return cursor; }
+
+    size_t GetLine() const { return line_number+1; }
+    size_t GetColumn() const { return column+1; }
+
+    Ch* PutBegin() { assert(false); return 0; }
+    void Put(Ch) { assert(false); }
+    void Flush() { assert(false); }
+    size_t PutEnd(Ch*) { assert(false); return 0; }
+
+};
+
+
+// Stream wrapper over bytes that are already in memory. The position, line and column count from the given
+// starting point, so errors in a slice of a bigger document are reported where they are in the whole document.
+class BufferStreamWrapper {
+private:
+    const char* data;
+    size_t length;
+    size_t buffer_cursor;
+    size_t cursor;
+    size_t line_number;
+    size_t column;
+
+    BufferStreamWrapper(const BufferStreamWrapper&);
+    BufferStreamWrapper& operator=(const BufferStreamWrapper&);
+
+public:
+    typedef char Ch;
+
+    BufferStreamWrapper(const char* data, size_t length, size_t offset = 0, size_t line = 1, size_t column = 1)
+        : data(data), length(length), buffer_cursor(0), cursor(offset), line_number(line-1), column(column-1) {}
+
+    Ch Peek() const {
+        return buffer_cursor < length ? data[buffer_cursor] : '\0';
+    }
+
+    Ch Take() {
+        if (buffer_cursor >= length) {
+            return '\0';
+        }
+
+        Ch result = data[buffer_cursor++];
+        cursor++;
+
+        if (result == '\n') {
+            line_number++;
+            column = 0;
+        }
+        else {
+            column++;
+        }
+
+        return result;
+    }
+
+    size_t Tell() const { return cursor; }
+
+    size_t GetLine() const { return line_number+1; }
+    size_t GetColumn() const { return column+1; }
+
+    Ch* PutBegin() { assert(false); return 0; }
+    void Put(Ch) { assert(false); }
+    void Flush() { assert(false); }
+    size_t PutEnd(Ch*) { assert(false); return 0; }
+
+};
+
+
+// Stream that puts a '[' in front of another stream. Used to parse the rest of a top level array after skipping
+// some of its entities, so the Reader sees a complete array. Tell(), GetLine() and GetColumn() are those of the
+// underlying stream.
+template <typename InputStream>
+class ResumedArrayStream {
+private:
+    InputStream& stream;
+    bool bracket_taken;
+
+    ResumedArrayStream(const ResumedArrayStream&);
+    ResumedArrayStream& operator=(const ResumedArrayStream&);
+
+public:
+    typedef char Ch;
+
+    ResumedArrayStream(InputStream& stream) : stream(stream), bracket_taken(false) {}
+
+    Ch Peek() {
+        return bracket_taken ? stream.Peek() : '[';
+    }
+
+    Ch Take() {
+        if (!bracket_taken) {
+            bracket_taken = true;
+            return '[';
+        }
+
+        return stream.Take();
+    }
+
+    size_t Tell() const { return stream.Tell(); }
+
+    size_t GetLine() const { return stream.GetLine(); }
+    size_t GetColumn() const { return stream.GetColumn(); }
+
+    Ch* PutBegin() { assert(false); return 0; }
+    void Put(Ch) { assert(false); }
+    void Flush() { assert(false); }
+    size_t PutEnd(Ch*) { assert(false); return 0; }
+
+};
+
+
+// Handler for validate(): builds nothing and only counts the entities, i.e. the objects MyHandlerDict would hand to
+// 'handle_dict'
+struct MyHandlerCount : public BaseReaderHandler<UTF8<>, MyHandlerCount> {
+    size_t depth;
+    bool root_is_array;
+    size_t entities;
+
+    MyHandlerCount() : depth(0), root_is_array(false), entities(0) {}
+
+    bool StartObject() {
+        depth++;
+        return true;
+    }
+
+    bool EndObject(SizeType memberCount) {
+        depth--;
+        if (depth == 0 || (depth == 1 && root_is_array)) {
+            entities++;
+        }
+        return true;
+    }
+
+    bool StartArray() {
+        if (depth == 0) {
+            root_is_array = true;
+        }
+        depth++;
+        return true;
+    }
+
+    bool EndArray(SizeType elementCount) {
+        depth--;
+        return true;
+    }
+};
+
 struct MyHandlerDebug : public BaseReaderHandler<UTF8<>, MyHandlerDebug> {
     bool Null() { cout << "Null()" << endl; return true; }
     bool Bool(bool b) { cout << "Bool(" << boolalpha << b << ")" << endl; return true; }
@@ -421,236 +885,434 @@ class MyHandlerDict : public BaseReaderHandler<UTF8<>, MyHandlerDict> {
 private:
     py::object py_handler;
     py::object dict_handler;
-    py::object py_Decimal;
+    DecimalFactory decimals;
     bool try_float_as_int;
     bool do_float_as_decimal;
     std::vector<py::object> context_stack;
-    std::vector<py::str> name_context;
+    std::vector<py::object> name_context;
     std::map <std::string, py::object> transit_map;
 
-public:
-    std::string fail_reason;
+    // Strings are handed over as bytes, without being decoded, if the handler has a true 'strings_as_bytes'
+    // attribute (the values) or 'keys_as_bytes' attribute (the member names). They are still checked for valid
+    // UTF-8 unless its 'validate_utf8' attribute is false. Transit encoded values are decoded as usual.
+    bool strings_as_bytes;
+    bool keys_as_bytes;
+    bool validate_utf8;
+
+    // Rough size of the JSON text of the entity being built, for the batch byte budget
+    size_t entity_bytes;
+    // Pass the sizes to the handler too, i.e. 'handle_dict(entity, size)', if it has a true 'pass_size' attribute
+    bool pass_size;
+
+    // The parse stops after 'limit' entities (zero means no limit), or when the handler's 'cancel_token' is
+    // cancelled. See should_stop().
+    size_t entity_count;
+    size_t limit;
+    py::object py_cancel_token;
+    const CancelToken* cancel_token;
+
+    // See set_item_key()
+    py::object item_key;
+
+    // Batch mode, used when the handler has a 'handle_batch' method: the entities are collected in a list that is
+    // handed over when it holds 'batch_size' entities or 'batch_bytes' bytes of JSON, or when its first entity has
+    // waited for 'batch_timeout' seconds. Zero means no limit.
+    py::object batch_handler;
+    py::list batch;
+    size_t batch_size;
+    size_t batch_bytes;
+    size_t batch_byte_count;
+    std::chrono::steady_clock::duration batch_timeout;
+    std::chrono::steady_clock::time_point batch_started;
+
+    // Field projection, used when the handler has a 'fields' attribute: only the selected members of the entities
+    // are built. No python objects are created for the other members, their values are only tracked by nesting.
+    static const int NO_KEY = -3;
+    bool project;
+    FieldProjection projection;
+    // The projection node of each open container, see FieldProjection
+    std::vector<int> projection_stack;
+    // The projection node of the value of the last key, or NO_KEY if the next value is not an object member
+    int key_projection;
+    // The number of open containers in a value that is left out
+    size_t skip_depth;
+
+    // Filtering, used when the handler has a 'where' attribute: only the entities for which all of its conditions
+    // hold are emitted. The conditions are tested on the values as they are parsed. As soon as one of them fails,
+    // whatever has been built of the entity is dropped and the rest of it is skipped.
+    bool filter;
+    EntityFilter entity_filter;
+    // The path node of each open object or array of the current entity, see PointerSelection
+    std::vector<int> filter_stack;
+    // The path node of the value of the last key
+    int filter_key_node;
+    size_t filter_depth;
+    bool filter_root_is_array;
+    // Which conditions have held for the current entity so far
+    std::vector<bool> conditions_met;
+    size_t conditions_met_count;
+    bool rejected;
+    // The sizes of the stacks when the current entity started
+    size_t entity_context_size;
+    size_t entity_name_size;
+    size_t entity_projection_size;
+
+    // Drops the entity that is being built and skips the rest of it
+    void reject_entity(size_t open_containers) {
+        rejected = true;
+        context_stack.resize(entity_context_size);
+        name_context.resize(entity_name_size);
+        projection_stack.resize(entity_projection_size);
+        key_projection = NO_KEY;
+        extract_stack.clear();
+        key_node = PointerSelection::NONE;
+        slot_values = slot_defaults;
+        skip_depth = open_containers;
+        raw_stack.resize(std::min(raw_stack.size(), entity_context_size));
+        raw_key_node = FieldProjection::NONE;
+        raw_open = 0;
+        raw_recorder.stop();
+    }
 
-    bool Null() {
-        if (context_stack.size() == 0) {
-            // Literal, we don't support it
-            return false;
+    void filter_scalar(const FilterValue& value) {
+        int node = filter_key_node;
+        filter_key_node = PointerSelection::NONE;
+
+        if (rejected || node == PointerSelection::NONE) {
+            return;
         }
 
-        py::object context_obj = context_stack.back();
+        for (int condition : entity_filter.paths().slots(node)) {
+            if (!entity_filter.test(condition, value)) {
+                reject_entity(filter_stack.size());
+                return;
+            }
 
-        if (py::isinstance<py::dict>(context_obj)) {
-            // key:value
-            py::str prop_name = name_context.back();
-            name_context.pop_back();
-            py::dict parent_dict = (py::dict)context_obj;
-            parent_dict[prop_name] = py::none();
-        }
-        else {
-            // [value1, value2]
-            py::list parent_list = (py::list)context_obj;
-            parent_list.append(py::none());
+            if (!conditions_met[condition]) {
+                conditions_met[condition] = true;
+                conditions_met_count++;
+            }
         }
-
-        return true;
     }
 
-    bool Bool(bool value) {
-        if (context_stack.size() == 0) {
-            // Literal, we don't support it
-            return false;
+    void filter_start_container(bool is_array) {
+        int node = filter_key_node;
+        filter_key_node = PointerSelection::NONE;
+
+        if (filter_depth == 0) {
+            filter_root_is_array = is_array;
         }
 
-        py::object context_obj = context_stack.back();
+        if (filter_stack.empty()) {
+            if (!is_array && (filter_depth == 0 || (filter_depth == 1 && filter_root_is_array))) {
+                // An entity
+                filter_stack.push_back(0);
+                conditions_met.assign(entity_filter.size(), false);
+                conditions_met_count = 0;
+                entity_context_size = context_stack.size();
+                entity_name_size = name_context.size();
+                entity_projection_size = projection_stack.size();
+            }
+        } else {
+            if (!rejected && node != PointerSelection::NONE && !entity_filter.paths().slots(node).empty()) {
+                // The conditions are on scalars. The caller skips the container itself.
+                reject_entity(filter_stack.size());
+            }
 
-        if (py::isinstance<py::dict>(context_obj)) {
-            // key:value
-            py::str prop_name = name_context.back();
-            name_context.pop_back();
-            py::dict parent_dict = (py::dict)context_obj;
-            parent_dict[prop_name] = value;
-        }
-        else {
-            // [value1, value2]
-            py::list parent_list = (py::list)context_obj;
-            parent_list.append(value);
+            // Members of arrays are not followed
+            if (is_array) {
+                node = PointerSelection::NONE;
+            }
+            filter_stack.push_back(node);
         }
 
-        return true;
+        filter_depth++;
     }
 
-    bool Int(int value) {
-        if (context_stack.size() == 0) {
-            // Literal, we don't support it
-            return false;
+    void filter_key(const char* str, SizeType length) {
+        if (!filter_stack.empty() && !rejected && filter_stack.back() != PointerSelection::NONE) {
+            filter_key_node = entity_filter.paths().find(filter_stack.back(), str, length);
         }
+    }
 
-        py::object context_obj = context_stack.back();
+    void filter_end_container() {
+        filter_depth--;
 
-        if (py::isinstance<py::dict>(context_obj)) {
-            // key:value
-            py::str prop_name = name_context.back();
-            name_context.pop_back();
-            py::dict parent_dict = (py::dict)context_obj;
-            parent_dict[prop_name] = value;
-        }
-        else {
-            // [value1, value2]
-            py::list parent_list = (py::list)context_obj;
-            parent_list.append(value);
+        if (filter_stack.empty()) {
+            return;
         }
 
-        return true;
-    }
+        if (filter_stack.size() == 1) {
+            // The end of an entity
+            if (!rejected && conditions_met_count < entity_filter.size()) {
+                reject_entity(1);
+            }
 
-    bool Uint(unsigned value) {
-        if (context_stack.size() == 0) {
-            // Literal, we don't support it
-            return false;
+            if (rejected) {
+                // Don't count the dropped entity in the size of the next one
+                entity_bytes = 0;
+                rejected = false;
+            }
         }
 
-        py::object context_obj = context_stack.back();
+        filter_stack.pop_back();
+    }
 
-        if (py::isinstance<py::dict>(context_obj)) {
-            // key:value
-            py::str prop_name = name_context.back();
-            name_context.pop_back();
-            py::dict parent_dict = (py::dict)context_obj;
-            parent_dict[prop_name] = value;
+    // Extraction, used when the handler has a 'pointers' attribute (a list of JSON Pointers): instead of the entities,
+    // tuples of the values the pointers point at are emitted, or of the 'pointer_defaults' where there is no such
+    // value. Only the pointed at values are built, the rest of the entity is only followed as far as the pointers go.
+    bool extract;
+    PointerSelection selection;
+    std::vector<py::object> slot_defaults;
+    std::vector<py::object> slot_values;
+
+    struct ExtractFrame {
+        int node;           // PointerSelection node, or NONE
+        bool built;         // A python object is built for it, and is on the context stack
+        bool in_parent;     // It goes into its parent when it ends, i.e. the parent is built too
+        bool is_array;
+        size_t index;       // Index of the next element, for arrays
+    };
+
+    // One frame per open object or array of the current entity
+    std::vector<ExtractFrame> extract_stack;
+    // The node of the value of the last key
+    int key_node;
+    // Where the value being added goes, see add_value()
+    int value_node;
+    bool value_in_parent;
+
+    // Works out the node of the value that starts now in the current entity, and if it goes into its parent
+    void extract_value(int& node, bool& in_parent) {
+        ExtractFrame& parent = extract_stack.back();
+
+        if (parent.node == PointerSelection::NONE) {
+            node = PointerSelection::NONE;
+        } else if (parent.is_array) {
+            node = selection.find(parent.node, parent.index);
+        } else {
+            node = key_node;
         }
-        else {
-            // [value1, value2]
-            py::list parent_list = (py::list)context_obj;
-            parent_list.append(value);
+
+        if (parent.is_array) {
+            parent.index++;
         }
 
-        return true;
+        key_node = PointerSelection::NONE;
+        in_parent = parent.built;
     }
 
-    bool Int64(int64_t value) {
-        if (context_stack.size() == 0) {
-            // Literal, we don't support it
+    bool has_slots(int node) const {
+        return node != PointerSelection::NONE && !selection.slots(node).empty();
+    }
+
+    // Starts an object or array when extracting. Returns false if it is left out, otherwise 'build' tells if a
+    // python object must be built for it.
+    bool extract_container(bool is_array, bool& build) {
+        if (skip_depth > 0) {
+            skip_depth++;
             return false;
         }
 
-        py::object context_obj = context_stack.back();
+        ExtractFrame frame = {0, false, false, is_array, 0};
 
-        if (py::isinstance<py::dict>(context_obj)) {
-            // key:value
-            py::str prop_name = name_context.back();
-            name_context.pop_back();
-            py::dict parent_dict = (py::dict)context_obj;
-            parent_dict[prop_name] = value;
-        }
-        else {
-            // [value1, value2]
-            py::list parent_list = (py::list)context_obj;
-            parent_list.append(value);
+        if (extract_stack.empty()) {
+            if (is_array) {
+                // The top level array is handled as usual, any other array outside of an entity is left out
+                build = context_stack.empty();
+                skip_depth = build ? 0 : 1;
+                return build;
+            }
+
+            // An entity
+            frame.built = has_slots(0);
+        } else {
+            extract_value(frame.node, frame.in_parent);
+            frame.built = frame.in_parent || has_slots(frame.node);
+
+            if (!frame.built && (frame.node == PointerSelection::NONE || !selection.has_children(frame.node))) {
+                skip_depth = 1;
+                return false;
+            }
         }
 
+        extract_stack.push_back(frame);
+        build = frame.built;
         return true;
     }
 
-    bool Uint64(uint64_t value) {
-        if (context_stack.size() == 0) {
-            // Literal, we don't support it
+    // Ends an object or array when extracting. Returns false if it is the top level array, which ends as usual.
+    bool end_extract_container() {
+        if (skip_depth > 0) {
+            skip_depth--;
+            return true;
+        }
+
+        if (extract_stack.empty()) {
             return false;
         }
 
-        py::object context_obj = context_stack.back();
+        ExtractFrame frame = extract_stack.back();
+        extract_stack.pop_back();
 
-        if (py::isinstance<py::dict>(context_obj)) {
-            // key:value
-            py::str prop_name = name_context.back();
-            name_context.pop_back();
-            py::dict parent_dict = (py::dict)context_obj;
-            parent_dict[prop_name] = value;
+        if (frame.built) {
+            py::object value = context_stack.back();
+            context_stack.pop_back();
+            value_node = frame.node;
+            value_in_parent = frame.in_parent;
+            add_value(value);
         }
-        else {
-            // [value1, value2]
-            py::list parent_list = (py::list)context_obj;
-            parent_list.append(value);
+
+        if (extract_stack.empty()) {
+            // The end of an entity
+            py::tuple values(slot_values.size());
+            for (size_t i = 0; i < slot_values.size(); i++) {
+                values[i] = slot_values[i];
+            }
+            slot_values = slot_defaults;
+            emit(values);
         }
 
         return true;
     }
 
-    bool is_integer(const std::string &str) {
-        return (str.find_first_not_of("-0123456789") == std::string::npos);
-    }
+    // Raw subtrees, used when the handler has a 'raw_depth' or 'raw_paths' attribute: the objects and arrays nested
+    // 'raw_depth' levels deep in an entity, or at one of the paths (lists of member names, see FieldProjection), are
+    // not built. The stream records their JSON text as it is (see RecordingStream) and they are handed over as
+    // 'raw_type(text)', or as bytes.
+    bool raw;
+    size_t raw_depth;
+    bool raw_by_path;
+    FieldProjection raw_selection;
+    // The raw_selection node of each object or array on the context stack
+    std::vector<int> raw_stack;
+    // The raw_selection node of the value of the last key
+    int raw_key_node;
+    // The number of open containers in the raw subtree being recorded
+    size_t raw_open;
+    py::object raw_type;
+
+    // Starts recording the object or array that starts now if it is a raw subtree, and returns true. Otherwise
+    // keeps track of its node.
+    bool start_raw(char bracket) {
+        // The nesting depth in the entity, where the entity (and the top level array) is at 0
+        size_t level = context_stack.size();
+        if (level > 0 && py::isinstance<py::list>(context_stack.front())) {
+            level--;
+        }
 
-    bool RawNumber(const char* str, SizeType length, bool copy) {
-        if (context_stack.size() == 0) {
-            // Literal, we don't support it
-            return false;
+        int node = FieldProjection::NONE;
+
+        if (raw_by_path) {
+            if (level == 0) {
+                node = 0;
+            } else if (py::isinstance<py::dict>(context_stack.back())) {
+                node = raw_key_node;
+            } else {
+                // The elements of an array share its node
+                node = raw_stack.back();
+            }
+            raw_key_node = FieldProjection::NONE;
         }
 
-        py::object py_value;
+        if ((raw_depth > 0 && level == raw_depth) || node == FieldProjection::WHOLE) {
+            raw_open = 1;
+            raw_recorder.start(bracket);
+            return true;
+        }
+
+        if (raw_by_path) {
+            raw_stack.push_back(node);
+        }
+        return false;
+    }
 
-        std::string s_str(str);
+    void raw_key(const char* str, SizeType length) {
+        int node = raw_stack.back();
 
-        if (is_integer(s_str)) {
-            // no fraction or exponent - definately an integer
-            //cout << "it's an int!" << endl;
-            py::str tmp(s_str);
-            py_value = tmp.cast<py::int_>();
+        if (node >= 0) {
+            raw_key_node = raw_selection.find(node, str, length);
         } else {
-            //cout << "it's a float!" << endl;
-            py_value = py_Decimal(str);
-
-            if (try_float_as_int == true) {
-                // If no fractional value, cast to int
-                py::int_ int_value = py_value.cast<py::int_>();
-                py::object func_eq = py_value.attr("__eq__");
-                if (func_eq(int_value).cast<bool>() == true) {
-                    //cout << "The float can be cast to an int!" << endl;
-                    py_value = int_value;
-                }
-            }
+            raw_key_node = FieldProjection::NONE;
         }
+    }
 
-        py::object context_obj = context_stack.back();
+    // Returns true if the object or array that ends now is in a raw subtree. If it is the subtree itself, it is done.
+    bool end_raw(char bracket) {
+        if (raw_open == 0) {
+            return false;
+        }
 
-        if (py::isinstance<py::dict>(context_obj)) {
-            // key:value
-            py::str prop_name = name_context.back();
-            name_context.pop_back();
-            py::dict parent_dict = (py::dict)context_obj;
+        if (--raw_open == 0) {
+            raw_recorder.finish(bracket);
+            const std::string& text = raw_recorder.recorded();
+            py::bytes bytes(text.data(), text.size());
 
-            parent_dict[prop_name] = py_value;
+            if (project) {
+                projection_stack.pop_back();
+            }
+            add_value(raw_type.is_none() ? py::object(bytes) : raw_type(bytes));
         }
-        else {
-            // [value1, value2]
-            py::list parent_list = (py::list)context_obj;
-            parent_list.append(py_value);
+        return true;
+    }
+
+    // Makes a bytes object of a string, see 'strings_as_bytes'. Returns false if it is not valid UTF-8.
+    bool make_bytes(const char* str, SizeType length, py::object& result) {
+        if (validate_utf8 && !utf8_valid(str, length)) {
+            fail_reason = "Invalid UTF-8 in string";
+            return false;
         }
 
+        result = py::bytes(str, length);
         return true;
     }
 
-    bool Double(double value) {
-        if (context_stack.size() == 0) {
-            // Literal, we don't support it
-            return false;
+    // True for a value that is the whole document and not an object
+    bool is_literal_root() const {
+        return context_stack.size() == 0 && extract_stack.empty();
+    }
+
+    // With an item path every value at the prefix is an entity, not just the objects. ItemPathHandler puts them in a
+    // made up top level array, so this tells if a value that is done is one of them.
+    bool is_item_value() const {
+        return has_item_path && context_stack.size() == 1 && py::isinstance<py::list>(context_stack.back());
+    }
+
+    // Emits an item that is not an object. The conditions of a filter only hold for objects, so it drops them.
+    void emit_item_value(py::object value) {
+        if (filter) {
+            entity_bytes = 0;
+            return;
         }
+        emit(value);
+    }
 
-        if (try_float_as_int == true) {
-            // Special case: reproduce ijson 2.3 bug: treat non-fractional floats as ints
-            double intpart;
-            if (modf(value, &intpart) == 0.0) {
-                return Int64((int64_t)value);
+    // Puts a value that is done into its parent (and its slots when extracting)
+    void add_value(py::object value) {
+        if (extract) {
+            if (value_node != PointerSelection::NONE) {
+                for (int slot : selection.slots(value_node)) {
+                    slot_values[slot] = value;
+                }
+            }
+
+            if (!value_in_parent) {
+                return;
             }
         }
 
+        if (is_item_value()) {
+            emit_item_value(value);
+            return;
+        }
 
         py::object context_obj = context_stack.back();
 
         if (py::isinstance<py::dict>(context_obj)) {
             // key:value
-            py::str prop_name = name_context.back();
+            py::object prop_name = name_context.back();
             name_context.pop_back();
             py::dict parent_dict = (py::dict)context_obj;
-
             parent_dict[prop_name] = value;
         }
         else {
@@ -658,413 +1320,2983 @@ public:
             py::list parent_list = (py::list)context_obj;
             parent_list.append(value);
         }
-
-        return true;
     }
 
-    bool String(const char* str, SizeType length, bool copy) {
-        if (context_stack.size() == 0) {
-            // Literal, we don't support it
+    // Works out the projection node of the value that starts now. Returns false if the value is left out.
+    bool project_value(bool is_container, int& node) {
+        bool is_member = key_projection != NO_KEY;
+
+        if (is_member) {
+            node = key_projection;
+            key_projection = NO_KEY;
+        } else if (projection_stack.empty()) {
+            node = FieldProjection::WHOLE;
+        } else {
+            // The elements of an array share its projection
+            node = projection_stack.back();
+        }
+
+        if (node == FieldProjection::NONE) {
             return false;
         }
 
-        py::object context_obj = context_stack.back();
+        if (!is_container && node != FieldProjection::WHOLE) {
+            // Only members of this value were selected, and it has none
+            if (is_member) {
+                name_context.pop_back();
+            }
+            return false;
+        }
 
-        std::string s_str(str);
+        return true;
+    }
 
-        py::object result_value;
+    // Returns true if the scalar value that starts now is left out by the projection or extraction
+    bool skip_scalar() {
+        if (skip_depth > 0 || raw_open > 0) {
+            return true;
+        }
 
-        if (!transit_map.empty()) {
-            if (s_str.length() > 1 && s_str[0] == '~') {
-                std::string prefix = s_str.substr(1, 1);
-                std::string value = s_str.substr(2);
+        if (extract) {
+            if (extract_stack.empty()) {
+                // Values in the top level array that are not entities are left out, literals fail as usual
+                return !context_stack.empty();
+            }
 
-                // cout << "Prefix: " << prefix << endl;
-                // cout << "Value: " << value << endl;
+            extract_value(value_node, value_in_parent);
+            return !value_in_parent && !has_slots(value_node);
+        }
 
-                if (transit_map.count(prefix) > 0) {
-                    py::object decode_func = transit_map[prefix];
+        int node;
+        return project && !project_value(false, node);
+    }
 
-                    if (prefix[0] == 't') {
-                        // Parse dates in C++
-                        try {
-                            result_value = decode_func(parse8601(value));
-                        } catch (py::error_already_set& ex) {
-                            std::stringstream reason;
-                            reason << "Failed to transit decode value '" << s_str << "'. Exception raised: " << ex.what();
-                            fail_reason = reason.str();
-                            ex.restore();
-                            PyErr_Clear();
+    // Same for an object or array, but sets 'node' to its projection node when it is kept
+    bool project_container(int& node) {
+        if (skip_depth > 0 || !project_value(true, node)) {
+            skip_depth++;
+            return false;
+        }
 
-                            return false;
-                        } catch (std::exception& ex) {
-                            std::stringstream reason;
-                            reason << "Failed to transit decode value '" << s_str << "'. Most likely not a ISO8601 date. Exception raised: " << ex.what();
-                            fail_reason = reason.str();
-                            return false;
-                        }
-                    } else {
-                        try {
-                            result_value = decode_func(value);
-                        } catch (py::error_already_set& ex) {
-                            std::stringstream reason;
-                            reason << "Failed to transit decode value '" << s_str << "'. Exception raised: " << ex.what();
-                            fail_reason = reason.str();
-                            ex.restore();
-                            PyErr_Clear();
+        return true;
+    }
 
-                            return false;
-                        }
-                    }
-                }
-            }
+    // Returns true if the object or array that ends now was left out by the projection
+    bool end_container() {
+        if (skip_depth > 0) {
+            skip_depth--;
+            return true;
         }
 
-        if (result_value == NULL || py::isinstance<py::none>(result_value)) {
-            try {
-                result_value = py::str(s_str);
-            } catch (std::exception& ex) {
-              std::stringstream orig_reason;
+        if (project) {
+            projection_stack.pop_back();
+        }
+        return false;
+    }
 
-              if (PyErr_Occurred()) {
-                PyObject *type, *value, *traceback;
-                PyErr_Fetch(&type, &value, &traceback);
-                PyErr_NormalizeException(&type, &value, &traceback);
+    void emit(py::object entity) {
+        if (emit_offset > 0) {
+            emit_offset--;
+            entity_bytes = 0;
+            return;
+        }
 
-                auto type_decref = make_decref_python_ptr(type);
-                auto value_decref = make_decref_python_ptr(value);
-                auto traceback_decref = make_decref_python_ptr(traceback);
+        entity_count++;
 
-                if (value != nullptr) {
-                    PyObject *py_str_value = PyObject_Str(value);
-                    auto decref_py_str_value = make_decref_python_ptr(py_str_value);
+        if (item_key_value) {
+            entity = py::make_tuple(item_key, entity);
+        }
 
-                    const char* raw_python_error_msg = PyUnicode_AsUTF8(py_str_value);
-                    std::string s_python_error_msg(raw_python_error_msg);
-                    orig_reason << s_python_error_msg;
-                }
+        if (!batch_handler) {
+            if (pass_size)
+                dict_handler(entity, entity_bytes);
+            else
+                dict_handler(entity);
+            entity_bytes = 0;
+            return;
+        }
 
-                PyErr_Clear();
-              } else {
-                    orig_reason << ex.what();
-              }
+        if (batch.size() == 0) {
+            batch_started = std::chrono::steady_clock::now();
+        }
 
-              // Try to convert the original string to a more suitable format for the error message
-              PyObject *orig_str = PyUnicode_DecodeUTF8(str, (size_t)length, "backslashreplace");
+        batch.append(entity);
+        batch_byte_count += entity_bytes;
+        entity_bytes = 0;
 
-              auto orig_str_decref = make_decref_python_ptr(orig_str);
+        if ((batch_size > 0 && batch.size() >= batch_size) || (limit > 0 && entity_count >= limit) ||
+            (batch_bytes > 0 && batch_byte_count >= batch_bytes) ||
+            (batch_timeout.count() > 0 && std::chrono::steady_clock::now() - batch_started >= batch_timeout)) {
+            flush();
+        }
+    }
 
-              const char* raw_python_orig_str = PyUnicode_AsUTF8(orig_str);
-              std::string s_raw_python_orig_str(raw_python_orig_str);
+public:
+    std::string fail_reason;
 
-              std::stringstream reason;
-              reason << "Failed to decode string '" << s_raw_python_orig_str << "'. Exception raised: " << orig_reason.str();
+    // Number of entities to skip, from the handler's 'offset' attribute. Like 'limit' it counts the entities that
+    // are emitted, so top level values that aren't objects don't count. The entry points skip the entities with an
+    // EntityScanner, without parsing them, unless a filter decides which are emitted; then emit() drops the first
+    // 'emit_offset' of them instead.
+    size_t offset;
+    size_t emit_offset;
+
+    // Go on with the next entity after an invalid one, if the handler has a true 'tolerant' attribute. The errors
+    // are then passed to its 'handle_entity_error' method, see parse_dict_by_entity().
+    bool tolerant;
+
+    // Convert floats exactly, to the closest double. The numbers are then parsed as text, like in decimal mode, and
+    // converted by decimal_to_double(). See exact_number() and parse_dict_stream().
+    bool exact_floats;
+
+    // Only the top level entities containing one of these byte strings are parsed, from the handler's 'contains'
+    // attribute. The others are skipped with an EntityScanner, see parse_dict_by_entity().
+    BytePatterns prefilter;
+
+    // The entities are the values at this ijson style prefix, from the handler's 'item_path' attribute (a list of
+    // names), instead of the elements of the top level array. With a true 'item_key_value' attribute the prefix
+    // names an object, and (name, value) tuples of its members are emitted. See ItemPathHandler.
+    bool has_item_path;
+    std::vector<std::string> item_path;
+    bool item_key_value;
+
+    // The layout of the stream, from the handler's 'format' attribute: a single document ("json"), newline
+    // delimited documents ("ndjson") or documents back to back ("concat"). In the latter two each document is
+    // parsed as a single document would be.
+    enum Format { JSON, NDJSON, CONCAT };
+    Format format;
+
+    // Takes down the text of the raw subtrees when the parse wraps its stream in a RecordingStream, which it must do
+    // if records_raw() is true
+    RawRecorder raw_recorder;
+
+    bool records_raw() const { return raw; }
+
+    // The name of the member that is the current entity, in key/value mode
+    void set_item_key(const char* str, size_t length) {
+        item_key = py::str(str, length);
+    }
 
-              fail_reason = reason.str();
-              return false;
-            }
+    bool Null() {
+        entity_bytes += 4;
+
+        if (filter) {
+            filter_scalar(FilterValue());
         }
 
-        if (py::isinstance<py::dict>(context_obj)) {
-            // key:value
-            py::str prop_name = name_context.back();
-            name_context.pop_back();
-            py::dict parent_dict = (py::dict)context_obj;
-            parent_dict[prop_name] = result_value;
+        if (skip_scalar()) {
+            return true;
         }
-        else {
-            // [value1, value2]
-            py::list parent_list = (py::list)context_obj;
 
-            parent_list.append(result_value);
+        if (is_literal_root()) {
+            // Literal, we don't support it
+            return false;
         }
 
-        return true;
-    }
+        add_value(py::none());
 
-    bool StartObject() {
-        context_stack.push_back(py::dict());
         return true;
     }
 
-    bool Key(const char* str, SizeType length, bool copy) {
-        try {
-          py::str key_value = py::str(str);
-          name_context.push_back(key_value);
-        } catch (std::exception& ex) {
+    bool Bool(bool value) {
+        entity_bytes += 5;
+
+        if (filter) {
+            filter_scalar(FilterValue::from_bool(value));
+        }
+
+        if (skip_scalar()) {
+            return true;
+        }
+
+        if (is_literal_root()) {
+            // Literal, we don't support it
+            return false;
+        }
+
+        add_value(py::cast(value));
+
+        return true;
+    }
+
+    bool Int(int value) {
+        entity_bytes += 8;
+
+        if (filter) {
+            filter_scalar(FilterValue::from_int(value));
+        }
+
+        if (skip_scalar()) {
+            return true;
+        }
+
+        if (is_literal_root()) {
+            // Literal, we don't support it
+            return false;
+        }
+
+        add_value(py::cast(value));
+
+        return true;
+    }
+
+    bool Uint(unsigned value) {
+        entity_bytes += 8;
+
+        if (filter) {
+            filter_scalar(FilterValue::from_int(value));
+        }
+
+        if (skip_scalar()) {
+            return true;
+        }
+
+        if (is_literal_root()) {
+            // Literal, we don't support it
+            return false;
+        }
+
+        add_value(py::cast(value));
+
+        return true;
+    }
+
+    bool Int64(int64_t value) {
+        entity_bytes += 8;
+
+        if (filter) {
+            filter_scalar(FilterValue::from_int(value));
+        }
+
+        if (skip_scalar()) {
+            return true;
+        }
+
+        if (is_literal_root()) {
+            // Literal, we don't support it
+            return false;
+        }
+
+        add_value(py::cast(value));
+
+        return true;
+    }
+
+    bool Uint64(uint64_t value) {
+        entity_bytes += 8;
+
+        if (filter) {
+            filter_scalar(FilterValue::from_uint(value));
+        }
+
+        if (skip_scalar()) {
+            return true;
+        }
+
+        if (is_literal_root()) {
+            // Literal, we don't support it
+            return false;
+        }
+
+        add_value(py::cast(value));
+
+        return true;
+    }
+
+    bool RawNumber(const char* str, SizeType length, bool copy) {
+        if (exact_floats) {
+            return exact_number(str, length);
+        }
+
+        entity_bytes += length + 1;
+
+        if (filter) {
+            filter_scalar(FilterValue::from_raw_number(str, length));
+        }
+
+        if (skip_scalar()) {
+            return true;
+        }
+
+        if (is_literal_root()) {
+            // Literal, we don't support it
+            return false;
+        }
+
+        py::object py_value;
+        NumberToken token(str, length);
+
+        if (token.is_integer()) {
+            py_value = make_int(token.negative, token.int_digits, token.int_length);
+        } else {
+            // Whole numbers with more digits than python converts from text by default are left to the Decimal
+            std::string digits;
+            NumberToken::Integral integral = try_float_as_int ?
+                    token.integral_digits(digits, 4000) : NumberToken::FRACTIONAL;
+
+            if (integral == NumberToken::INTEGRAL) {
+                py_value = make_int(token.negative && digits != "0", digits.data(), digits.size());
+            } else {
+                py_value = decimals.make(str, length);
+
+                if (integral == NumberToken::TOO_LONG) {
+                    py_value = py_value.cast<py::int_>();
+                }
+            }
+        }
+
+        add_value(py_value);
+
+        return true;
+    }
+
+    // Passes a number on as the reader would have without kParseNumbersAsStringsFlag, but with floats converted
+    // exactly, see 'exact_floats'
+    bool exact_number(const char* str, size_t length) {
+        NumberToken token(str, length);
+
+        if (token.is_integer() && token.int_length <= 20) {
+            // Whole numbers that fit in 64 bits stay integers, larger ones become doubles
+            const uint64_t max_value = std::numeric_limits<uint64_t>::max();
+            uint64_t value = 0;
+            bool fits = true;
+
+            for (size_t i = 0; i < token.int_length && fits; i++) {
+                uint64_t digit = (uint64_t)(token.int_digits[i] - '0');
+                fits = value <= (max_value - digit) / 10;
+                value = value * 10 + digit;
+            }
+
+            if (fits && !token.negative) {
+                return Uint64(value);
+            }
+            if (fits && value <= (uint64_t)1 << 63) {
+                return Int64((int64_t)(~value + 1));
+            }
+        }
+
+        double value;
+        if (!decimal_to_double(token, value)) {
+            // Too many digits for the fast paths to decide, python's own conversion is exact as well
+            value = PyOS_string_to_double(str, nullptr, nullptr);
+            if (value == -1.0 && PyErr_Occurred()) {
+                throw py::error_already_set();
+            }
+        }
+
+        if (std::isinf(value)) {
+            // Rounds past the largest double, which rapidjson's own conversion reports as kParseErrorNumberTooBig
+            fail_reason = "Number too big to be stored in double";
+            return false;
+        }
+
+        return Double(value);
+    }
+
+    bool Double(double value) {
+        entity_bytes += 8;
+
+        if (is_literal_root()) {
+            // Literal, we don't support it
+            return false;
+        }
+
+        if (try_float_as_int == true) {
+            // Special case: reproduce ijson 2.3 bug: treat non-fractional floats as ints
+            double intpart;
+            if (modf(value, &intpart) == 0.0) {
+                return Int64((int64_t)value);
+            }
+        }
+
+        if (filter) {
+            filter_scalar(FilterValue::from_double(value));
+        }
+
+        if (skip_scalar()) {
+            return true;
+        }
+
+
+        add_value(py::cast(value));
+
+        return true;
+    }
+
+    bool String(const char* str, SizeType length, bool copy) {
+        entity_bytes += length + 3;
+
+        if (filter) {
+            filter_scalar(FilterValue::from_string(str, length));
+        }
+
+        if (skip_scalar()) {
+            return true;
+        }
+
+        if (is_literal_root()) {
+            // Literal, we don't support it
+            return false;
+        }
+
+        py::object result_value;
+
+        if (strings_as_bytes && (transit_map.empty() || length < 2 || str[0] != '~')) {
+            // Can't be transit encoded
+            if (!make_bytes(str, length, result_value)) {
+                return false;
+            }
+
+            add_value(result_value);
+            return true;
+        }
+
+        if (!transit_map.empty()) {
+            std::string s_str(str);
+
+            if (s_str.length() > 1 && s_str[0] == '~') {
+                std::string prefix = s_str.substr(1, 1);
+                std::string value = s_str.substr(2);
+
+                // cout << "Prefix: " << prefix << endl;
+                // cout << "Value: " << value << endl;
+
+                if (transit_map.count(prefix) > 0) {
+                    py::object decode_func = transit_map[prefix];
+
+                    if (prefix[0] == 't') {
+                        // Parse dates in C++
+                        try {
+                            result_value = decode_func(parse8601(value));
+                        } catch (py::error_already_set& ex) {
+                            std::stringstream reason;
+                            reason << "Failed to transit decode value '" << s_str << "'. Exception raised: " << ex.what();
+                            fail_reason = reason.str();
+                            ex.restore();
+                            PyErr_Clear();
+
+                            return false;
+                        } catch (std::exception& ex) {
+                            std::stringstream reason;
+                            reason << "Failed to transit decode value '" << s_str << "'. Most likely not a ISO8601 date. Exception raised: " << ex.what();
+                            fail_reason = reason.str();
+                            return false;
+                        }
+                    } else {
+                        try {
+                            if (decode_func.is(decimals.type())) {
+                                result_value = decimals.make(value.data(), value.size());
+                            } else {
+                                result_value = decode_func(value);
+                            }
+                        } catch (py::error_already_set& ex) {
+                            std::stringstream reason;
+                            reason << "Failed to transit decode value '" << s_str << "'. Exception raised: " << ex.what();
+                            fail_reason = reason.str();
+                            ex.restore();
+                            PyErr_Clear();
+
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+
+        if ((result_value == NULL || py::isinstance<py::none>(result_value)) && strings_as_bytes) {
+            if (!make_bytes(str, length, result_value)) {
+                return false;
+            }
+        } else if (result_value == NULL || py::isinstance<py::none>(result_value)) {
+            try {
+                result_value = make_str(str, length);
+            } catch (std::exception& ex) {
+              std::stringstream orig_reason;
+
+              if (PyErr_Occurred()) {
+                PyObject *type, *value, *traceback;
+                PyErr_Fetch(&type, &value, &traceback);
+                PyErr_NormalizeException(&type, &value, &traceback);
+
+                auto type_decref = make_decref_python_ptr(type);
+                auto value_decref = make_decref_python_ptr(value);
+                auto traceback_decref = make_decref_python_ptr(traceback);
+
+                if (value != nullptr) {
+                    PyObject *py_str_value = PyObject_Str(value);
+                    auto decref_py_str_value = make_decref_python_ptr(py_str_value);
+
+                    const char* raw_python_error_msg = PyUnicode_AsUTF8(py_str_value);
+                    std::string s_python_error_msg(raw_python_error_msg);
+                    orig_reason << s_python_error_msg;
+                }
+
+                PyErr_Clear();
+              } else {
+                    orig_reason << ex.what();
+              }
+
+              // Try to convert the original string to a more suitable format for the error message
+              PyObject *orig_str = PyUnicode_DecodeUTF8(str, (size_t)length, "backslashreplace");
+
+              auto orig_str_decref = make_decref_python_ptr(orig_str);
+
+              const char* raw_python_orig_str = PyUnicode_AsUTF8(orig_str);
+              std::string s_raw_python_orig_str(raw_python_orig_str);
+
+              std::stringstream reason;
+              reason << "Failed to decode string '" << s_raw_python_orig_str << "'. Exception raised: " << orig_reason.str();
+
+              fail_reason = reason.str();
+              return false;
+            }
+        }
+
+        add_value(result_value);
+
+        return true;
+    }
+
+    bool StartObject() {
+        entity_bytes += 1;
+
+        if (filter) {
+            filter_start_container(false);
+        }
+
+        if (skip_depth > 0) {
+            skip_depth++;
+            return true;
+        }
+
+        if (raw_open > 0) {
+            raw_open++;
+            return true;
+        }
+
+        if (extract) {
+            bool build;
+
+            if (!extract_container(false, build) || !build) {
+                return true;
+            }
+        } else if (project) {
+            int node;
+
+            if (!project_container(node)) {
+                return true;
+            }
+
+            if (context_stack.size() == 0 ||
+                    (context_stack.size() == 1 && py::isinstance<py::list>(context_stack.back()))) {
+                // An entity
+                node = 0;
+            }
+            projection_stack.push_back(node);
+        }
+
+        if (raw && start_raw('{')) {
+            return true;
+        }
+
+        context_stack.push_back(py::dict());
+        return true;
+    }
+
+    bool Key(const char* str, SizeType length, bool copy) {
+        entity_bytes += length + 4;
+
+        if (filter) {
+            filter_key(str, length);
+        }
+
+        if (skip_depth > 0 || raw_open > 0) {
+            return true;
+        }
+
+        if (raw_by_path) {
+            raw_key(str, length);
+        }
+
+        if (extract) {
+            const ExtractFrame& parent = extract_stack.back();
+            key_node = (parent.node == PointerSelection::NONE) ?
+                    PointerSelection::NONE : selection.find(parent.node, str, length);
+
+            if (!parent.built) {
+                // The name is only needed by a parent that is built
+                return true;
+            }
+        } else if (project) {
+            int node = projection_stack.back();
+            key_projection = (node == FieldProjection::WHOLE) ? node : projection.find(node, str, length);
+
+            if (key_projection == FieldProjection::NONE) {
+                // No need for the name of a member that is left out
+                return true;
+            }
+        }
+
+        if (keys_as_bytes) {
+            py::object key_value;
+
+            if (!make_bytes(str, length, key_value)) {
+                return false;
+            }
+
+            name_context.push_back(key_value);
+            return true;
+        }
+
+        try {
+          name_context.push_back(make_str(str, length));
+        } catch (std::exception& ex) {
           std::stringstream orig_reason;
 
-          if (PyErr_Occurred()) {
-            PyObject *type, *value, *traceback;
-            PyErr_Fetch(&type, &value, &traceback);
-            PyErr_NormalizeException(&type, &value, &traceback);
+          if (PyErr_Occurred()) {
+            PyObject *type, *value, *traceback;
+            PyErr_Fetch(&type, &value, &traceback);
+            PyErr_NormalizeException(&type, &value, &traceback);
+
+            auto type_decref = make_decref_python_ptr(type);
+            auto value_decref = make_decref_python_ptr(value);
+            auto traceback_decref = make_decref_python_ptr(traceback);
+
+            if (value != nullptr) {
+                PyObject *py_str_value = PyObject_Str(value);
+                auto decref_py_str_value = make_decref_python_ptr(py_str_value);
+
+                const char* raw_python_error_msg = PyUnicode_AsUTF8(py_str_value);
+                std::string s_python_error_msg(raw_python_error_msg);
+                orig_reason << s_python_error_msg;
+            }
+
+            PyErr_Clear();
+          } else {
+            orig_reason << ex.what();
+          }
+
+          // Try to convert the original string to a more suitable format for the error message
+          PyObject *orig_str = PyUnicode_DecodeUTF8(str, (size_t)length, "backslashreplace");
+
+          auto orig_str_decref = make_decref_python_ptr(orig_str);
+
+          const char* raw_python_orig_str = PyUnicode_AsUTF8(orig_str);
+          std::string s_raw_python_orig_str(raw_python_orig_str);
+
+          std::stringstream reason;
+          reason << "Failed to decode string '" << s_raw_python_orig_str << "'. Exception raised: " << orig_reason.str();
+
+          fail_reason = reason.str();
+          return false;
+        }
+
+        return true;
+    }
+
+    bool EndObject(SizeType memberCount) {
+        entity_bytes += 1;
+
+        if (filter) {
+            filter_end_container();
+        }
+
+        if (end_raw('}') || (extract ? end_extract_container() : end_container())) {
+            return true;
+        }
+
+        py::object entity = context_stack.back();
+
+        context_stack.pop_back();
+        if (raw_by_path) {
+            raw_stack.pop_back();
+        }
+
+        if (context_stack.size() == 1 && py::isinstance<py::list>(context_stack.back())) {
+            // End of entity in a normal list of entities
+
+            emit(entity);
+        }
+        else if (context_stack.size() == 0) {
+            // Allow single object JSON
+
+            emit(entity);
+        }
+        else {
+            py::object parent = context_stack.back();
+
+            if (py::isinstance<py::dict>(parent)) {
+                // Parent is a dict, add the object to the current property
+                py::object prop_name = name_context.back();
+                name_context.pop_back();
+                py::dict parent_dict = (py::dict)parent;
+                parent_dict[prop_name] = entity;
+            }
+            else {
+                // Parent is a list, append the object
+                py::list parent_list = (py::list)parent;
+                parent_list.append(entity);
+            }
+        }
+
+        return true;
+    }
+
+    bool StartArray() {
+        entity_bytes += 1;
+
+        if (filter) {
+            filter_start_container(true);
+        }
+
+        if (skip_depth > 0) {
+            skip_depth++;
+            return true;
+        }
+
+        if (raw_open > 0) {
+            raw_open++;
+            return true;
+        }
+
+        if (extract) {
+            bool build;
+
+            if (!extract_container(true, build) || !build) {
+                return true;
+            }
+        } else if (project) {
+            int node;
+
+            if (!project_container(node)) {
+                return true;
+            }
+            projection_stack.push_back(node);
+        }
+
+        if (raw && start_raw('[')) {
+            return true;
+        }
+
+        context_stack.push_back(py::list());
+        return true;
+    }
+
+    bool EndArray(SizeType elementCount) {
+        entity_bytes += 1;
+
+        if (filter) {
+            filter_end_container();
+        }
+
+        if (end_raw(']') || (extract ? end_extract_container() : end_container())) {
+            return true;
+        }
+
+        py::object list = context_stack.back();
+        context_stack.pop_back();
+        if (raw_by_path) {
+            raw_stack.pop_back();
+        }
+
+        if (is_item_value()) {
+            emit_item_value(list);
+        } else if (context_stack.size() > 0) {
+            py::object parent = context_stack.back();
+
+            if (py::isinstance<py::dict>(parent)) {
+                py::object prop_name = name_context.back();
+                name_context.pop_back();
+                py::dict parent_dict = (py::dict)parent;
+                parent_dict[prop_name] = list;
+            }
+            else {
+                py::list parent_list = (py::list)parent;
+                parent_list.append(list);
+            }
+        }
+
+        return true;
+    }
+
+    // Hands the entities collected so far to the handler in batch mode. Must be called before reporting the end of
+    // the stream or an error, so no entities are left behind.
+    void flush() {
+        if (batch_handler && batch.size() > 0) {
+            py::list entities = batch;
+            size_t byte_count = batch_byte_count;
+            batch = py::list();
+            batch_byte_count = 0;
+            if (pass_size)
+                batch_handler(entities, byte_count);
+            else
+                batch_handler(entities);
+        }
+    }
+
+    // True when the parse should end without reading any further
+    bool should_stop() const {
+        return (limit > 0 && entity_count >= limit) || (cancel_token != nullptr && cancel_token->is_cancelled());
+    }
+
+    // Drops any half built entity, so the handler can be fed a new one after a failure
+    void reset() {
+        context_stack.clear();
+        name_context.clear();
+        fail_reason.clear();
+        entity_bytes = 0;
+        projection_stack.clear();
+        key_projection = NO_KEY;
+        skip_depth = 0;
+        extract_stack.clear();
+        key_node = PointerSelection::NONE;
+        slot_values = slot_defaults;
+        filter_stack.clear();
+        filter_key_node = PointerSelection::NONE;
+        filter_depth = 0;
+        rejected = false;
+        raw_stack.clear();
+        raw_key_node = FieldProjection::NONE;
+        raw_open = 0;
+        raw_recorder.stop();
+    }
+
+    MyHandlerDict(py::object py_handler, py::object py_transit_map, py::object do_float_as_int)
+            : decimals(get_decimal_type()), strings_as_bytes(false), keys_as_bytes(false), validate_utf8(true),
+              entity_bytes(0), pass_size(false), entity_count(0), limit(0), cancel_token(nullptr), batch_size(0),
+              batch_bytes(0), batch_byte_count(0), batch_timeout(0), project(false), key_projection(NO_KEY),
+              skip_depth(0), filter(false), filter_key_node(PointerSelection::NONE), filter_depth(0),
+              filter_root_is_array(false), conditions_met_count(0), rejected(false), entity_context_size(0),
+              entity_name_size(0), entity_projection_size(0), extract(false), key_node(PointerSelection::NONE),
+              value_node(PointerSelection::NONE), value_in_parent(true), raw(false), raw_depth(0), raw_by_path(false),
+              raw_key_node(FieldProjection::NONE), raw_open(0), offset(0), emit_offset(0), tolerant(false),
+              exact_floats(false), has_item_path(false), item_key_value(false), format(JSON) {
+        pass_size = py::getattr(py_handler, "pass_size", py::bool_(false)).cast<bool>();
+        strings_as_bytes = py::getattr(py_handler, "strings_as_bytes", py::bool_(false)).cast<bool>();
+        keys_as_bytes = py::getattr(py_handler, "keys_as_bytes", py::bool_(false)).cast<bool>();
+        validate_utf8 = py::getattr(py_handler, "validate_utf8", py::bool_(true)).cast<bool>();
+        tolerant = py::getattr(py_handler, "tolerant", py::bool_(false)).cast<bool>();
+
+        py::object py_format = py::getattr(py_handler, "format", py::none());
+        if (!py::isinstance<py::none>(py_format)) {
+            std::string name = py_format.cast<std::string>();
+
+            if (name == "ndjson") {
+                format = NDJSON;
+            } else if (name == "concat") {
+                format = CONCAT;
+            } else if (name != "json") {
+                throw py::value_error("Unknown format '" + name + "'");
+            }
+        }
+
+        py::object py_item_path = py::getattr(py_handler, "item_path", py::none());
+        if (!py::isinstance<py::none>(py_item_path)) {
+            has_item_path = true;
+            item_path = py_item_path.cast<std::vector<std::string> >();
+            item_key_value = py::getattr(py_handler, "item_key_value", py::bool_(false)).cast<bool>();
+        }
+
+        py::object py_raw_depth = py::getattr(py_handler, "raw_depth", py::none());
+        if (!py::isinstance<py::none>(py_raw_depth)) {
+            raw = true;
+            raw_depth = py_raw_depth.cast<size_t>();
+        }
+
+        // Each raw path is a member name or a list of names, like the fields
+        py::object py_raw_paths = py::getattr(py_handler, "raw_paths", py::none());
+        if (!py::isinstance<py::none>(py_raw_paths)) {
+            raw = true;
+            raw_by_path = true;
+
+            for (auto path : py::list(py_raw_paths)) {
+                if (py::isinstance<py::str>(path)) {
+                    raw_selection.add(std::vector<std::string>(1, path.cast<std::string>()));
+                } else {
+                    raw_selection.add(path.cast<std::vector<std::string> >());
+                }
+            }
+        }
+        raw_type = py::getattr(py_handler, "raw_type", py::none());
+
+        py::object py_contains = py::getattr(py_handler, "contains", py::none());
+        if (!py::isinstance<py::none>(py_contains)) {
+            for (auto pattern : py::list(py_contains)) {
+                prefilter.add(pattern.cast<std::string>());
+            }
+        }
+
+        // Each field is a member name or a list of names, the path to a nested member
+        py::object py_fields = py::getattr(py_handler, "fields", py::none());
+        if (!py::isinstance<py::none>(py_fields)) {
+            project = true;
+
+            for (auto field : py::list(py_fields)) {
+                if (py::isinstance<py::str>(field)) {
+                    projection.add(std::vector<std::string>(1, field.cast<std::string>()));
+                } else {
+                    projection.add(field.cast<std::vector<std::string> >());
+                }
+            }
+        }
+
+        // Each condition is a (path, operator, operand) tuple, where the path is a list of member names and the
+        // operand a list of values for 'in'
+        py::object py_where = py::getattr(py_handler, "where", py::none());
+        if (!py::isinstance<py::none>(py_where)) {
+            filter = true;
+
+            for (auto py_condition : py::list(py_where)) {
+                std::vector<std::string> path;
+                std::string op;
+                py::object operand;
+                std::tie(path, op, operand) =
+                        py_condition.cast<std::tuple<std::vector<std::string>, std::string, py::object> >();
+
+                if (op == "=~") {
+                    std::string pattern = operand.cast<std::string>();
+                    if (!entity_filter.add_match(path, pattern)) {
+                        throw py::value_error("Invalid regular expression '" + pattern + "'");
+                    }
+                    continue;
+                }
+
+                static const std::map<std::string, EntityFilter::Op> operators = {
+                    {"==", EntityFilter::EQ}, {"!=", EntityFilter::NE}, {"<", EntityFilter::LT},
+                    {"<=", EntityFilter::LE}, {">", EntityFilter::GT}, {">=", EntityFilter::GE},
+                    {"in", EntityFilter::IN}};
+
+                if (operators.count(op) == 0) {
+                    throw py::value_error("Unknown operator '" + op + "'");
+                }
+
+                py::list py_operands;
+                if (op == "in") {
+                    py_operands = py::list(operand);
+                } else {
+                    py_operands.append(operand);
+                }
+
+                // The strings stay alive in 'py_operands' until the filter has copied them
+                std::vector<FilterValue> operands;
+                for (auto py_operand : py_operands) {
+                    if (py_operand.is_none()) {
+                        operands.push_back(FilterValue());
+                    } else if (py::isinstance<py::bool_>(py_operand)) {
+                        operands.push_back(FilterValue::from_bool(py_operand.cast<bool>()));
+                    } else if (py::isinstance<py::int_>(py_operand)) {
+                        operands.push_back(FilterValue::from_int(py_operand.cast<int64_t>()));
+                    } else if (py::isinstance<py::float_>(py_operand)) {
+                        operands.push_back(FilterValue::from_double(py_operand.cast<double>()));
+                    } else {
+                        Py_ssize_t length;
+                        const char* str = PyUnicode_AsUTF8AndSize(py_operand.ptr(), &length);
+                        if (str == nullptr) {
+                            throw py::error_already_set();
+                        }
+                        operands.push_back(FilterValue::from_string(str, (size_t)length));
+                    }
+                }
+
+                entity_filter.add(path, operators.at(op), operands);
+            }
+        }
+
+        py::object py_pointers = py::getattr(py_handler, "pointers", py::none());
+        if (!py::isinstance<py::none>(py_pointers)) {
+            extract = true;
+
+            for (auto py_pointer : py::list(py_pointers)) {
+                std::string source = py_pointer.cast<std::string>();
+                Pointer pointer(source.data(), source.size());
+
+                if (!pointer.IsValid()) {
+                    std::stringstream message;
+                    message << "Invalid JSON Pointer '" << source << "' at position " << pointer.GetParseErrorOffset();
+                    throw py::value_error(message.str());
+                }
+
+                std::vector<std::string> tokens;
+                for (size_t i = 0; i < pointer.GetTokenCount(); i++) {
+                    const Pointer::Token& token = pointer.GetTokens()[i];
+                    tokens.push_back(std::string(token.name, token.length));
+                }
+                selection.add(tokens);
+            }
+
+            py::object py_defaults = py::getattr(py_handler, "pointer_defaults", py::none());
+            if (py::isinstance<py::none>(py_defaults)) {
+                slot_defaults.assign(selection.size(), py::none());
+            } else {
+                for (auto py_default : py::list(py_defaults)) {
+                    slot_defaults.push_back(py::reinterpret_borrow<py::object>(py_default));
+                }
+
+                if (slot_defaults.size() != selection.size()) {
+                    throw py::value_error("There must be a default for each JSON Pointer");
+                }
+            }
+            slot_values = slot_defaults;
+        }
+
+        py::object py_limit = py::getattr(py_handler, "limit", py::none());
+        if (!py::isinstance<py::none>(py_limit)) {
+            limit = py_limit.cast<size_t>();
+        }
+
+        py::object py_offset = py::getattr(py_handler, "offset", py::none());
+        if (!py::isinstance<py::none>(py_offset)) {
+            offset = py_offset.cast<size_t>();
+        }
+
+        if (filter || !prefilter.empty() || (has_item_path && extract)) {
+            // Only parsing an entity tells if it is emitted (with pointers, items that aren't objects are not)
+            emit_offset = offset;
+            offset = 0;
+        }
+
+        py_cancel_token = py::getattr(py_handler, "cancel_token", py::none());
+        if (py::isinstance<CancelToken>(py_cancel_token)) {
+            cancel_token = py_cancel_token.cast<CancelToken*>();
+        }
+
+        if (py::hasattr(py_handler, "handle_batch")) {
+            batch_handler = py_handler.attr("handle_batch");
+            batch_size = py::getattr(py_handler, "batch_size", py::int_(0)).cast<size_t>();
+            batch_bytes = py::getattr(py_handler, "batch_bytes", py::int_(0)).cast<size_t>();
+            batch_timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(py::getattr(py_handler, "batch_timeout", py::float_(0.0)).cast<double>()));
+        } else {
+            dict_handler = py_handler.attr("handle_dict");
+        }
+
+        if (!py::isinstance<py::none>(do_float_as_int)) {
+            try_float_as_int = do_float_as_int.cast<py::bool_>();
+        } else
+            try_float_as_int = false;
+
+        if (!py::isinstance<py::none>(py_transit_map)) {
+            py::dict transit_decode_map = (py::dict)py_transit_map;
+
+            for (auto item : transit_decode_map) {
+                py::object py_key = item.first.cast<py::object>();
+                std::string key = py_key.cast<std::string>();
+                py::object py_value = item.second.cast<py::object>();
+                transit_map.emplace(key, py_value);
+            }
+        }
+    }
+};
+
+
+// Record types written to a shared ring by parse_to_ring()
+enum RingRecordType {
+    RING_ENTITY_PART = 1,   // Start or middle of an entity too big for a single record
+    RING_ENTITY = 2,        // A complete entity, or the last part of one
+    RING_PARSE_ERROR = 3,
+    RING_END_SOURCE = 4,
+    RING_OS_ERROR = 5
+};
+
+// Encodes the entities in a JSON stream into a compact binary form and writes them to a shared ring, without
+// creating any python objects. It can therefore run without the GIL. Each value is a tag byte, followed by:
+//
+//   'n', 't', 'f', '{', '}', '[', ']'   nothing
+//   'i', 'u', 'd'                       8 byte int64_t, uint64_t or double
+//   's', 'k', 'N'                       varint length, the bytes of the string, key or raw number and a '\0'
+//
+// The entities are the same ones MyHandlerDict would hand to 'handle_dict'. replay_binary_entity() turns them
+// back into SAX events.
+class MyHandlerBinary : public BaseReaderHandler<UTF8<>, MyHandlerBinary> {
+private:
+    SharedRing* ring;
+    std::vector<char> containers;
+    size_t entity_depth;
+    std::string entity;
+
+    void put_varint(uint64_t n) {
+        while (n >= 0x80) {
+            entity += (char)((n & 0x7F) | 0x80);
+            n >>= 7;
+        }
+        entity += (char)n;
+    }
+
+    template <typename T>
+    bool put_value(char tag, T value) {
+        if (containers.empty()) {
+            // Literal, we don't support it
+            return false;
+        }
+
+        if (entity_depth > 0) {
+            entity += tag;
+            entity.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+
+        return true;
+    }
+
+    bool put_tag(char tag) {
+        if (containers.empty()) {
+            return false;
+        }
+
+        if (entity_depth > 0) {
+            entity += tag;
+        }
+
+        return true;
+    }
+
+    bool put_string(char tag, const char* str, SizeType length) {
+        if (containers.empty()) {
+            return false;
+        }
+
+        if (entity_depth > 0) {
+            entity += tag;
+            put_varint(length);
+            entity.append(str, length);
+            entity += '\0';
+        }
+
+        return true;
+    }
+
+    bool write_entity() {
+        size_t max_part = ring->max_record_size();
+        size_t offset = 0;
+
+        while (entity.size() - offset > max_part) {
+            if (!ring->write(RING_ENTITY_PART, entity.data() + offset, max_part)) {
+                abandoned = true;
+                return false;
+            }
+            offset += max_part;
+        }
+
+        if (!ring->write(RING_ENTITY, entity.data() + offset, entity.size() - offset)) {
+            abandoned = true;
+            return false;
+        }
+
+        return true;
+    }
+
+public:
+    // Set if the reader went away while we were writing
+    bool abandoned;
+
+    bool Null() { return put_tag('n'); }
+    bool Bool(bool b) { return put_tag(b ? 't' : 'f'); }
+    bool Int(int i) { return put_value('i', (int64_t)i); }
+    bool Uint(unsigned u) { return put_value('u', (uint64_t)u); }
+    bool Int64(int64_t i) { return put_value('i', i); }
+    bool Uint64(uint64_t u) { return put_value('u', u); }
+    bool Double(double d) { return put_value('d', d); }
+    bool RawNumber(const char* str, SizeType length, bool copy) { return put_string('N', str, length); }
+    bool String(const char* str, SizeType length, bool copy) { return put_string('s', str, length); }
+    bool Key(const char* str, SizeType length, bool copy) { return put_string('k', str, length); }
+
+    bool StartObject() {
+        if (entity_depth > 0) {
+            entity_depth++;
+            entity += '{';
+        }
+        else if (containers.empty() || (containers.size() == 1 && containers[0] == '[')) {
+            // Start of an entity
+            entity.clear();
+            entity_depth = 1;
+            entity += '{';
+        }
+
+        containers.push_back('{');
+        return true;
+    }
+
+    bool EndObject(SizeType memberCount) {
+        containers.pop_back();
+
+        if (entity_depth > 0) {
+            entity += '}';
+            entity_depth--;
+
+            if (entity_depth == 0) {
+                return write_entity();
+            }
+        }
+
+        return true;
+    }
+
+    bool StartArray() {
+        if (entity_depth > 0) {
+            entity_depth++;
+            entity += '[';
+        }
+
+        containers.push_back('[');
+        return true;
+    }
+
+    bool EndArray(SizeType elementCount) {
+        containers.pop_back();
+
+        if (entity_depth > 0) {
+            entity += ']';
+            entity_depth--;
+        }
+
+        return true;
+    }
+
+    MyHandlerBinary(SharedRing* ring) : ring(ring), entity_depth(0), abandoned(false) {}
+};
+
+static uint64_t read_varint(const char*& data, const char* end) {
+    uint64_t value = 0;
+    unsigned shift = 0;
+
+    while (data < end) {
+        unsigned char byte = (unsigned char)*data++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+        shift += 7;
+    }
+
+    return value;
+}
+
+// Feeds an entity encoded by MyHandlerBinary to a SAX handler. Returns false if the handler refused one of the
+// events or the encoding is broken.
+template <typename Handler>
+bool replay_binary_entity(const char* data, size_t length, Handler& handler) {
+    const char* end = data + length;
+
+    while (data < end) {
+        char tag = *data++;
+        bool result;
+
+        switch (tag) {
+            case 'n': result = handler.Null(); break;
+            case 't': result = handler.Bool(true); break;
+            case 'f': result = handler.Bool(false); break;
+            case '{': result = handler.StartObject(); break;
+            case '}': result = handler.EndObject(0); break;
+            case '[': result = handler.StartArray(); break;
+            case ']': result = handler.EndArray(0); break;
+            case 'i':
+            case 'u':
+            case 'd': {
+                if (end - data < 8) {
+                    return false;
+                }
+
+                if (tag == 'i') {
+                    int64_t value;
+                    std::memcpy(&value, data, 8);
+                    result = handler.Int64(value);
+                } else if (tag == 'u') {
+                    uint64_t value;
+                    std::memcpy(&value, data, 8);
+                    result = handler.Uint64(value);
+                } else {
+                    double value;
+                    std::memcpy(&value, data, 8);
+                    result = handler.Double(value);
+                }
+                data += 8;
+                break;
+            }
+            case 's':
+            case 'k':
+            case 'N': {
+                uint64_t str_length = read_varint(data, end);
+                if ((uint64_t)(end - data) < str_length + 1) {
+                    return false;
+                }
+
+                const char* str = data;
+                data += str_length + 1;
+
+                if (tag == 's') {
+                    result = handler.String(str, (SizeType)str_length, true);
+                } else if (tag == 'k') {
+                    result = handler.Key(str, (SizeType)str_length, true);
+                } else {
+                    result = handler.RawNumber(str, (SizeType)str_length, true);
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+
+        if (!result) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+class MyHandlerString : public BaseReaderHandler<UTF8<>, MyHandlerString> {
+private:
+    py::object py_handler;
+    py::object string_handler;
+    std::vector<int> cursor_stack;
+    TrackingStreamWrapper *tracking_stream;
+    py::object context;
+
+public:
+    bool Null() { return true; }
+    bool Bool(bool b) { return true; }
+    bool Int(int i) { return true; }
+    bool Uint(unsigned u) { return true; }
+    bool Int64(int64_t i) { return true; }
+    bool Uint64(uint64_t u) { return true; }
+    bool Double(double d) { return true; }
+    bool String(const char* str, SizeType length, bool copy) { return true; }
+    bool StartObject() {
+        // cout << "Start Object" << endl;
+
+        if (cursor_stack.size() == 0) {
+            // Clear the accumulation buffer when we start on a toplevel entity
+            tracking_stream->reset_accumulated_buffer();
+        }
+        cursor_stack.push_back(tracking_stream->Tell());
+        return true;
+    }
+    bool Key(const char* str, SizeType length, bool copy) { return true; }
+    bool EndObject(SizeType memberCount) {
+        //cout << "End Object" << endl;
+
+        cursor_stack.pop_back();
+
+        if (cursor_stack.size() == 0) {
+            // End of entity
+
+            std::string json_data = tracking_stream->accumulated_buffer;
+            json_data += "}";
+
+            string_handler(json_data);
+
+            // Clear the accumulation buffer
+            tracking_stream->reset_accumulated_buffer();
+        }
+
+        return true;
+    }
+    bool StartArray() {
+        // cout << "Start Array" << endl;
+        return true;
+    }
+    bool EndArray(SizeType elementCount) {
+        //cout << "End Array" << endl;
+        return true;
+    }
+
+    MyHandlerString(py::object py_handler, TrackingStreamWrapper *stream) {
+        string_handler = py_handler.attr("handle_string");
+        tracking_stream = stream;
+    }
+};
+
+int parse_strings(py::object stream, py::object handler) {
+
+    Reader reader;
+
+    TrackingStreamWrapper stream_wrapper(stream);
+    MyHandlerString my_handler(handler, &stream_wrapper);
+
+    reader.IterativeParseInit();
+    while (!reader.IterativeParseComplete() && !reader.HasParseError()) {
+        reader.IterativeParseNext<kParseDefaultFlags>(stream_wrapper, my_handler);
+        // Your handler has been called once.
+        //cout << "Handler was called!" << endl;
+    }
+
+    if (reader.HasParseError()) {
+        py::object handle_error = handler.attr("handle_error");
+
+        if (handle_error != NULL && !py::isinstance<py::none>(handle_error)) {
+            int error_code = (int)reader.GetParseErrorCode();
+            size_t offset = reader.GetErrorOffset();
+            size_t line_no = stream_wrapper.GetLine();
+            size_t column = stream_wrapper.GetColumn();
+
+            handle_error(error_code, offset, line_no, column);
+        }
+    }
+
+    py::object handle_end_stream = handler.attr("handle_end_stream");
+    handle_end_stream();
+
+    //cout << "Finished parsing file" << endl;
+
+    return 0;
+}
+
+// Skips the first 'count' top level entities of a document with an EntityScanner, which only looks at brackets
+// and quotes; no values are parsed. Returns true if the rest of the top level array should be parsed, in which case
+// the stream is left where a ResumedArrayStream can take over. Structural errors are left in the scanner's error_*
+// members.
+template <typename InputStream>
+bool skip_entities(InputStream& stream, EntityScanner& scanner, size_t count) {
+    while (scanner.object_count < count) {
+        size_t available;
+        const char* data = stream.PeekBuffer(available);
+
+        if (available == 0) {
+            EntityScanner::Result result = scanner.finish();
+
+            if (result == EntityScanner::INCOMPLETE) {
+                scanner.error_code = kParseErrorUnspecificSyntaxError;
+                scanner.error_offset = scanner.offset();
+                scanner.error_line = scanner.current_line();
+                scanner.error_column = scanner.current_column();
+            }
+            return false;
+        }
+
+        size_t consumed;
+        size_t entity_start;
+        EntityScanner::Result result = scanner.scan(data, available, consumed, entity_start);
+        stream.Advance(consumed, scanner.current_line(), scanner.current_column());
+
+        if (result == EntityScanner::ERROR) {
+            return false;
+        }
+    }
+
+    if (!scanner.is_root_array()) {
+        // The single entity was skipped
+        return false;
+    }
+
+    // Leave the stream after the comma following the last skipped entity (or at the closing bracket)
+    while (stream.Peek() == ' ' || stream.Peek() == '\n' || stream.Peek() == '\r' || stream.Peek() == '\t') {
+        stream.Take();
+    }
+
+    rapidjson::ParseErrorCode error_code = kParseErrorNone;
+
+    if (stream.Peek() == ',') {
+        stream.Take();
+
+        while (stream.Peek() == ' ' || stream.Peek() == '\n' || stream.Peek() == '\r' || stream.Peek() == '\t') {
+            stream.Take();
+        }
+
+        if (stream.Peek() == ']') {
+            error_code = kParseErrorValueInvalid;
+        }
+    } else if (stream.Peek() != ']') {
+        error_code = kParseErrorArrayMissCommaOrSquareBracket;
+    }
+
+    if (error_code != kParseErrorNone) {
+        scanner.error_code = error_code;
+        scanner.error_offset = stream.Tell();
+        scanner.error_line = stream.GetLine();
+        scanner.error_column = stream.GetColumn();
+        return false;
+    }
+
+    return true;
+}
+
+template <unsigned extraFlags, typename InputStream, typename Handler>
+void parse_steps(Reader& reader, InputStream& stream_wrapper, Handler& handler, const MyHandlerDict& my_handler,
+                 bool do_float_as_decimal) {
+    reader.IterativeParseInit();
+
+    // Each step calls the handler once. Errors are left in the reader.
+    while (!reader.IterativeParseComplete() && !reader.HasParseError() && !my_handler.should_stop()) {
+        if (do_float_as_decimal) {
+            reader.IterativeParseNext<kParseDefaultFlags|kParseNumbersAsStringsFlag|extraFlags>(stream_wrapper,
+                                                                                                handler);
+        } else {
+            reader.IterativeParseNext<kParseDefaultFlags|extraFlags>(stream_wrapper, handler);
+        }
+    }
+}
+
+// Feeds the document to 'handler' until it ends, the parse fails or 'my_handler' says stop. 'extraFlags' are added
+// to the parse flags.
+template <unsigned extraFlags, typename InputStream, typename Handler>
+void parse_iteratively(Reader& reader, InputStream& stream_wrapper, Handler& handler, MyHandlerDict& my_handler,
+                       bool do_float_as_decimal) {
+    if (my_handler.records_raw()) {
+        // The iterative parser tells the handler about brackets before taking them
+        RecordingStream<InputStream> recording_stream(stream_wrapper, my_handler.raw_recorder, false);
+        parse_steps<extraFlags>(reader, recording_stream, handler, my_handler, do_float_as_decimal);
+    } else {
+        parse_steps<extraFlags>(reader, stream_wrapper, handler, my_handler, do_float_as_decimal);
+    }
+}
+
+template <typename InputStream>
+void parse_dict_entities(InputStream& stream_wrapper, py::object handler, MyHandlerDict& my_handler,
+                         bool do_float_as_decimal) {
+    Reader reader;
+
+    if (my_handler.has_item_path) {
+        // The offset is applied to the items
+        ItemPathHandler<MyHandlerDict> item_handler(my_handler, my_handler.item_path, my_handler.item_key_value,
+                                                    my_handler.offset);
+        parse_iteratively<0>(reader, stream_wrapper, item_handler, my_handler, do_float_as_decimal);
+    } else {
+        parse_iteratively<0>(reader, stream_wrapper, my_handler, my_handler, do_float_as_decimal);
+    }
+
+    my_handler.flush();
+
+    if (reader.HasParseError()) {
+        py::object handle_error = handler.attr("handle_error");
+
+        if (handle_error != NULL && !py::isinstance<py::none>(handle_error)) {
+            int error_code = (int)reader.GetParseErrorCode();
+            size_t offset = reader.GetErrorOffset();
+            size_t line_no = stream_wrapper.GetLine();
+            size_t column = stream_wrapper.GetColumn();
+
+            handle_error(error_code, offset, line_no, column, my_handler.fail_reason);
+        }
+    }
+}
+
+// Parses one entity, or document, that has been cut out of the stream. 'offset', 'line' and 'column' are where it
+// starts. Values that are not entities are only checked. If it is invalid, the error goes to the handler's
+// 'handle_entity_error' (with the raw bytes of the entity) in tolerant mode and to 'handle_error' otherwise, and
+// false is returned.
+bool parse_entity_span(Reader& reader, py::object handler, MyHandlerDict& my_handler, const char* data,
+                       size_t length, size_t offset, size_t line, size_t column, bool is_entity,
+                       bool do_float_as_decimal) {
+    BufferStreamWrapper stream_wrapper(data, length, offset, line, column);
+
+    if (is_entity && my_handler.records_raw()) {
+        RecordingStream<BufferStreamWrapper> recording_stream(stream_wrapper, my_handler.raw_recorder, true);
+
+        if (do_float_as_decimal)
+            reader.Parse<kParseDefaultFlags|kParseNumbersAsStringsFlag>(recording_stream, my_handler);
+        else
+            reader.Parse<kParseDefaultFlags>(recording_stream, my_handler);
+    } else if (is_entity) {
+        if (do_float_as_decimal)
+            reader.Parse<kParseDefaultFlags|kParseNumbersAsStringsFlag>(stream_wrapper, my_handler);
+        else
+            reader.Parse<kParseDefaultFlags>(stream_wrapper, my_handler);
+    } else {
+        // Not an entity, but it must still be valid JSON
+        BaseReaderHandler<UTF8<> > null_handler;
+        reader.Parse<kParseDefaultFlags>(stream_wrapper, null_handler);
+    }
+
+    if (!reader.HasParseError()) {
+        return true;
+    }
+
+    std::string fail_reason = my_handler.fail_reason;
+    my_handler.reset();
+    my_handler.flush();
+
+    if (my_handler.tolerant) {
+        handler.attr("handle_entity_error")((int)reader.GetParseErrorCode(), reader.GetErrorOffset(),
+                                            stream_wrapper.GetLine(), stream_wrapper.GetColumn(), fail_reason,
+                                            py::bytes(data, length));
+    } else {
+        handler.attr("handle_error")((int)reader.GetParseErrorCode(), reader.GetErrorOffset(),
+                                     stream_wrapper.GetLine(), stream_wrapper.GetColumn(), fail_reason);
+    }
+    return false;
+}
+
+// Parses an entity found by an EntityScanner, see parse_entity_span()
+bool parse_scanned_entity(Reader& reader, py::object handler, MyHandlerDict& my_handler,
+                          const EntityScanner& scanner, const char* data, size_t length, bool do_float_as_decimal) {
+    return parse_entity_span(reader, handler, my_handler, data, length, scanner.entity_offset, scanner.entity_line,
+                             scanner.entity_column, scanner.entity_kind == '{' || !scanner.is_root_array(),
+                             do_float_as_decimal);
+}
+
+// Parses a document one top level entity at a time: the entities are found with an EntityScanner and each of them
+// is parsed on its own. This is used in two cases:
+//
+// - In tolerant mode an invalid entity is reported through the handler's 'handle_entity_error' (with its raw bytes)
+//   and the parse goes on with the next one. After an error between the entities, e.g. a missing comma, the
+//   scanner skips ahead to the next object in the top level array; the skipped bytes are reported as the raw bytes
+//   of the error. Errors the parse can't recover from, such as garbage after the top level array, go to
+//   'handle_error'.
+// - With a prefilter only the entities whose raw bytes contain one of the handler's patterns are parsed. The others
+//   are only scanned, so they are not validated.
+//
+// The entity boundaries are found by counting brackets, so an entity with unbalanced brackets or an unterminated
+// string can swallow the entities after it.
+template <typename InputStream>
+void parse_dict_by_entity(InputStream& stream_wrapper, py::object handler, MyHandlerDict& my_handler,
+                          bool do_float_as_decimal) {
+    EntityScanner scanner;
+    // Reused for all the entities
+    Reader reader;
+    bool prefiltered = !my_handler.prefilter.empty();
+    // The bytes of the current entity if it spans several buffers, or the bytes skipped after an error between the
+    // entities
+    std::string span;
+    // The error between the entities that is being recovered from
+    int resync_error_code = 0;
+    size_t resync_error_offset = 0;
+    size_t resync_error_line = 0;
+    size_t resync_error_column = 0;
+
+    while (!my_handler.should_stop()) {
+        size_t available;
+        const char* data = stream_wrapper.PeekBuffer(available);
+
+        if (available == 0) {
+            break;
+        }
+
+        bool continued = scanner.in_entity();
+        bool resyncing = scanner.is_resyncing();
+        // Entities before the handler's offset are only scanned
+        bool skipping = scanner.object_count < my_handler.offset;
+        size_t consumed;
+        size_t entity_start;
+        EntityScanner::Result result = scanner.scan(data, available, consumed, entity_start);
+
+        if (resyncing) {
+            span.append(data, consumed);
+
+            if (!scanner.is_resyncing()) {
+                my_handler.flush();
+                handler.attr("handle_entity_error")(resync_error_code, resync_error_offset, resync_error_line,
+                                                    resync_error_column, std::string(), py::bytes(span));
+                span.clear();
+            }
+        } else if (result == EntityScanner::ENTITY) {
+            if (!skipping) {
+                const char* entity = data + entity_start;
+                size_t entity_length = consumed - entity_start;
+
+                if (continued) {
+                    span.append(entity, entity_length);
+                    entity = span.data();
+                    entity_length = span.size();
+                }
+
+                // The whole entity is in this buffer unless it was continued, so it is parsed where it is
+                if ((!prefiltered || my_handler.prefilter.search(entity, entity_length)) &&
+                        !parse_scanned_entity(reader, handler, my_handler, scanner, entity, entity_length,
+                                              do_float_as_decimal) &&
+                        !my_handler.tolerant) {
+                    return;
+                }
+            }
+            span.clear();
+        } else if (result != EntityScanner::ERROR && scanner.in_entity() && !skipping) {
+            if (!continued) {
+                span.clear();
+            }
+            span.append(data + entity_start, consumed - entity_start);
+        }
+
+        stream_wrapper.Advance(consumed, scanner.current_line(), scanner.current_column());
+
+        if (result == EntityScanner::ERROR) {
+            resync_error_code = (int)scanner.error_code;
+            resync_error_offset = scanner.error_offset;
+            resync_error_line = scanner.error_line;
+            resync_error_column = scanner.error_column;
+
+            if (!my_handler.tolerant || !scanner.resync()) {
+                my_handler.flush();
+                handler.attr("handle_error")((int)scanner.error_code, scanner.error_offset, scanner.error_line,
+                                             scanner.error_column, std::string());
+                return;
+            }
+            span.clear();
+        }
+    }
+
+    my_handler.flush();
+
+    if (my_handler.should_stop()) {
+        return;
+    }
+
+    bool resyncing = scanner.is_resyncing();
+    bool skipping = scanner.object_count < my_handler.offset;
+    EntityScanner::Result result = scanner.finish();
+
+    if (resyncing) {
+        // The input ended while skipping
+        handler.attr("handle_entity_error")(resync_error_code, resync_error_offset, resync_error_line,
+                                            resync_error_column, std::string(), py::bytes(span));
+    } else if (result == EntityScanner::ENTITY && !skipping) {
+        // A number or literal ended by the end of the input
+        if (!prefiltered || my_handler.prefilter.search(span.data(), span.size())) {
+            parse_scanned_entity(reader, handler, my_handler, scanner, span.data(), span.size(),
+                                 do_float_as_decimal);
+            my_handler.flush();
+        }
+    } else if (result == EntityScanner::INCOMPLETE) {
+        // Let the parser tell what is wrong with the entity, if it was kept
+        if (skipping || parse_scanned_entity(reader, handler, my_handler, scanner, span.data(), span.size(),
+                                             do_float_as_decimal)) {
+            if (my_handler.tolerant) {
+                handler.attr("handle_entity_error")((int)kParseErrorUnspecificSyntaxError, scanner.offset(),
+                                                    scanner.current_line(), scanner.current_column(),
+                                                    std::string(), py::bytes(span));
+            } else {
+                handler.attr("handle_error")((int)kParseErrorUnspecificSyntaxError, scanner.offset(),
+                                             scanner.current_line(), scanner.current_column(), std::string());
+            }
+        }
+    } else if (result == EntityScanner::ERROR) {
+        handler.attr("handle_error")((int)scanner.error_code, scanner.error_offset, scanner.error_line,
+                                     scanner.error_column, std::string());
+    }
+}
+
+// Parses one line of newline delimited JSON, see parse_dict_lines(). Returns false if the parse should end.
+bool parse_line(Reader& reader, py::object handler, MyHandlerDict& my_handler, const char* data, size_t length,
+                size_t offset, size_t line, size_t& line_count, bool do_float_as_decimal) {
+    size_t start = 0;
+
+    while (start < length && (data[start] == ' ' || data[start] == '\t' || data[start] == '\r')) {
+        start++;
+    }
+
+    if (start == length) {
+        // Blank lines are allowed
+        return true;
+    }
+
+    if (line_count++ < my_handler.offset) {
+        return true;
+    }
+
+    if (!my_handler.prefilter.empty() && !my_handler.prefilter.search(data, length)) {
+        return true;
+    }
 
-            auto type_decref = make_decref_python_ptr(type);
-            auto value_decref = make_decref_python_ptr(value);
-            auto traceback_decref = make_decref_python_ptr(traceback);
+    return parse_entity_span(reader, handler, my_handler, data, length, offset, line, 1, true, do_float_as_decimal) ||
+           my_handler.tolerant;
+}
 
-            if (value != nullptr) {
-                PyObject *py_str_value = PyObject_Str(value);
-                auto decref_py_str_value = make_decref_python_ptr(py_str_value);
+// Parses newline delimited JSON, one document per line. The lines are found with memchr() and parsed one at a time,
+// where they are in the stream's buffer unless they span buffers. Blank lines are skipped. As with
+// parse_dict_by_entity(), invalid lines can be skipped in tolerant mode, and only the lines containing one of the
+// prefilter's patterns are parsed. The offset skips lines without parsing them.
+template <typename InputStream>
+void parse_dict_lines(InputStream& stream_wrapper, py::object handler, MyHandlerDict& my_handler,
+                      bool do_float_as_decimal) {
+    // Reused for all the lines
+    Reader reader;
+    // A line that spans buffers
+    std::string span;
+    bool continued = false;
+    size_t line_offset = 0;
+    size_t line = 1;
+    // Number of lines that are not blank
+    size_t line_count = 0;
+
+    while (!my_handler.should_stop()) {
+        size_t available;
+        const char* data = stream_wrapper.PeekBuffer(available);
+
+        if (available == 0) {
+            break;
+        }
 
-                const char* raw_python_error_msg = PyUnicode_AsUTF8(py_str_value);
-                std::string s_python_error_msg(raw_python_error_msg);
-                orig_reason << s_python_error_msg;
+        if (!continued) {
+            line_offset = stream_wrapper.Tell();
+            line = stream_wrapper.GetLine();
+        }
+
+        const char* newline = static_cast<const char*>(std::memchr(data, '\n', available));
+
+        if (newline == nullptr) {
+            span.append(data, available);
+            continued = true;
+            stream_wrapper.Advance(available, line, stream_wrapper.GetColumn() + available);
+            continue;
+        }
+
+        size_t length = (size_t)(newline - data);
+        const char* text = data;
+        size_t text_length = length;
+
+        if (continued) {
+            span.append(data, length);
+            text = span.data();
+            text_length = span.size();
+        }
+
+        bool go_on = parse_line(reader, handler, my_handler, text, text_length, line_offset, line, line_count,
+                                do_float_as_decimal);
+        span.clear();
+        continued = false;
+        stream_wrapper.Advance(length + 1, line + 1, 1);
+
+        if (!go_on) {
+            return;
+        }
+    }
+
+    my_handler.flush();
+
+    if (continued && !my_handler.should_stop()) {
+        // The last line has no newline
+        parse_line(reader, handler, my_handler, span.data(), span.size(), line_offset, line, line_count,
+                   do_float_as_decimal);
+        my_handler.flush();
+    }
+}
+
+// Parses JSON documents that follow each other, with or without whitespace in between, i.e. '{...}{...}'. One
+// Reader parses them all, stopping at the end of each document. The first 'offset' documents are parsed without
+// building anything.
+template <typename InputStream>
+void parse_dict_concatenated(InputStream& stream_wrapper, py::object handler, MyHandlerDict& my_handler,
+                             bool do_float_as_decimal) {
+    Reader reader;
+    BaseReaderHandler<UTF8<> > null_handler;
+    size_t document_count = 0;
+
+    while (!my_handler.should_stop()) {
+        while (stream_wrapper.Peek() == ' ' || stream_wrapper.Peek() == '\n' || stream_wrapper.Peek() == '\r' ||
+               stream_wrapper.Peek() == '\t') {
+            stream_wrapper.Take();
+        }
+
+        if (stream_wrapper.Peek() == '\0') {
+            break;
+        }
+
+        if (document_count++ < my_handler.offset) {
+            parse_iteratively<kParseStopWhenDoneFlag>(reader, stream_wrapper, null_handler, my_handler, false);
+        } else {
+            parse_iteratively<kParseStopWhenDoneFlag>(reader, stream_wrapper, my_handler, my_handler,
+                                                      do_float_as_decimal);
+        }
+
+        if (reader.HasParseError()) {
+            my_handler.flush();
+            handler.attr("handle_error")((int)reader.GetParseErrorCode(), reader.GetErrorOffset(),
+                                         stream_wrapper.GetLine(), stream_wrapper.GetColumn(),
+                                         my_handler.fail_reason);
+            return;
+        }
+    }
+
+    my_handler.flush();
+}
+
+template <typename InputStream>
+int parse_dict_stream(InputStream& stream_wrapper, py::object handler, py::object transit_decode_map,
+                      py::object do_float_as_int, py::object py_do_float_as_decimal) {
+    MyHandlerDict my_handler(handler, transit_decode_map, do_float_as_int);
+
+    bool do_float_as_decimal = false;
+
+    if (!py::isinstance<py::none>(py_do_float_as_decimal)) {
+        do_float_as_decimal = py_do_float_as_decimal.cast<py::bool_>();
+    }
+
+    // Floats are converted exactly if the handler has a true 'exact_floats' attribute. Like decimals they are then
+    // converted from the number text, and decimal mode takes precedence.
+    my_handler.exact_floats = !do_float_as_decimal &&
+            py::getattr(handler, "exact_floats", py::bool_(false)).cast<bool>();
+    bool numbers_as_strings = do_float_as_decimal || my_handler.exact_floats;
+
+    if (my_handler.format == MyHandlerDict::NDJSON) {
+        parse_dict_lines(stream_wrapper, handler, my_handler, numbers_as_strings);
+    } else if (my_handler.format == MyHandlerDict::CONCAT) {
+        parse_dict_concatenated(stream_wrapper, handler, my_handler, numbers_as_strings);
+    } else if (my_handler.has_item_path) {
+        // The entities are not in a top level array, so they can't be scanned for
+        parse_dict_entities(stream_wrapper, handler, my_handler, numbers_as_strings);
+    } else if (my_handler.tolerant || !my_handler.prefilter.empty()) {
+        parse_dict_by_entity(stream_wrapper, handler, my_handler, numbers_as_strings);
+    } else if (my_handler.offset == 0) {
+        parse_dict_entities(stream_wrapper, handler, my_handler, numbers_as_strings);
+    } else {
+        EntityScanner scanner;
+
+        if (skip_entities(stream_wrapper, scanner, my_handler.offset)) {
+            ResumedArrayStream<InputStream> resumed_stream(stream_wrapper);
+            parse_dict_entities(resumed_stream, handler, my_handler, numbers_as_strings);
+        } else if (scanner.error_code != kParseErrorNone) {
+            handler.attr("handle_error")((int)scanner.error_code, scanner.error_offset, scanner.error_line,
+                                         scanner.error_column, std::string());
+        }
+    }
+
+    py::object handle_end_stream = handler.attr("handle_end_stream");
+    handle_end_stream();
+
+    //cout << "Finished parsing file" << endl;
+
+    return 0;
+}
+
+int parse_dict(py::object stream, py::object handler, py::object transit_decode_map,
+               py::object do_float_as_int, py::object py_do_float_as_decimal) {
+    StreamWrapper stream_wrapper(stream);
+
+    return parse_dict_stream(stream_wrapper, handler, transit_decode_map, do_float_as_int, py_do_float_as_decimal);
+}
+
+// Outcome of validate_source()
+struct ValidationResult {
+    bool valid;
+    size_t entities;
+    size_t bytes;
+    int error_code;
+    size_t error_offset;
+    size_t error_line;
+    size_t error_column;
+};
+
+// Checks a whole document without building any python objects. Must be called with the GIL released.
+template <typename InputStream>
+ValidationResult validate_stream(InputStream& stream_wrapper) {
+    Reader reader;
+    MyHandlerCount count_handler;
+
+    // Numbers are validated but not converted, and the encoding is checked too
+    reader.Parse<kParseDefaultFlags|kParseValidateEncodingFlag|kParseNumbersAsStringsFlag>(stream_wrapper,
+                                                                                         count_handler);
+
+    ValidationResult result = {!reader.HasParseError(), count_handler.entities, stream_wrapper.Tell(), 0, 0, 0, 0};
+
+    if (reader.HasParseError()) {
+        result.error_code = (int)reader.GetParseErrorCode();
+        result.error_offset = reader.GetErrorOffset();
+        result.error_line = stream_wrapper.GetLine();
+        result.error_column = stream_wrapper.GetColumn();
+    }
+
+    return result;
+}
+
+// Validates a file (given by its path) or a python stream and counts its entities. The GIL is released throughout,
+// except while reading from a python stream. Returns (valid, entities, bytes, error_code, offset, line, column).
+py::tuple validate_source(py::object source) {
+    ValidationResult result;
+
+    if (py::isinstance<py::str>(source)) {
+        std::string path = source.cast<std::string>();
+        FileStreamWrapper stream_wrapper(path);
+
+        if (!stream_wrapper.is_open()) {
+            errno = stream_wrapper.open_errno;
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+            throw py::error_already_set();
+        }
+
+        GILReleaser gil_releaser;
+        result = validate_stream(stream_wrapper);
+    } else {
+        StreamWrapper stream_wrapper(source);
+        stream_wrapper.gil_released = true;
+
+        GILReleaser gil_releaser;
+        result = validate_stream(stream_wrapper);
+    }
+
+    return py::make_tuple(result.valid, result.entities, result.bytes, result.error_code, result.error_offset,
+                          result.error_line, result.error_column);
+}
+
+// An entity picked by sample_source(), kept as its raw bytes until the scan is done
+struct SampledEntity {
+    size_t index;
+    size_t offset;
+    size_t line;
+    size_t column;
+    std::string bytes;
+
+    bool operator<(const SampledEntity& other) const { return index < other.index; }
+};
+
+// Picks the entities for sample_source(), either uniformly at random (reservoir sampling, algorithm R) or every
+// 'stride'-th one
+class EntitySampler {
+private:
+    size_t k;
+    size_t stride;
+    std::mt19937_64 random;
+
+    // A uniformly distributed number below 'range', with Lemire's multiply and shift ("Fast Random Integer Generation
+    // in an Interval"). The standard distributions are implementation defined, while mt19937_64's output is not, so
+    // this keeps a seed's sample the same across standard libraries.
+    uint64_t below(uint64_t range) {
+        Uint128 product = multiply_64(random(), range);
+
+        if (product.low < range) {
+            // Rejects the few values that would make some results more likely than others
+            uint64_t threshold = (0 - range) % range;
+
+            while (product.low < threshold) {
+                product = multiply_64(random(), range);
             }
+        }
+        return product.high;
+    }
 
-            PyErr_Clear();
-          } else {
-            orig_reason << ex.what();
-          }
+public:
+    std::vector<SampledEntity> chosen;
+
+    EntitySampler(size_t k, size_t stride, uint64_t seed) : k(k), stride(stride), random(seed) {}
+
+    // Returns the slot in 'chosen' that the entity with the given index goes to, or -1 if it is not picked
+    long pick(size_t index) {
+        if (stride > 0) {
+            if (index % stride != 0 || (k > 0 && chosen.size() >= k)) {
+                return -1;
+            }
+            chosen.push_back(SampledEntity());
+            return (long)chosen.size() - 1;
+        }
+
+        if (index < k) {
+            chosen.push_back(SampledEntity());
+            return (long)index;
+        }
+
+        size_t slot = (size_t)below((uint64_t)index + 1);
+        return slot < k ? (long)slot : -1;
+    }
+
+    // True when no later entity can be picked any more
+    bool done() const {
+        return stride > 0 && k > 0 && chosen.size() >= k;
+    }
+};
+
+// Scans a document with an EntityScanner and keeps only the raw bytes of the sampled entities. Must be called with
+// the GIL released. Returns false on a structural error, which is left in the scanner's error_* members.
+template <typename InputStream>
+bool scan_sample(InputStream& stream_wrapper, EntityScanner& scanner, EntitySampler& sampler) {
+    size_t candidates = 0;
+    long slot = -1;
+    std::string current;
+
+    while (true) {
+        if (slot < 0 && sampler.done()) {
+            // No need to read the rest
+            return true;
+        }
+
+        size_t available;
+        const char* data = stream_wrapper.PeekBuffer(available);
+
+        if (available == 0) {
+            break;
+        }
+
+        bool continued = scanner.in_entity();
+        size_t consumed;
+        size_t entity_start;
+        EntityScanner::Result result = scanner.scan(data, available, consumed, entity_start);
+
+        if (result == EntityScanner::ERROR) {
+            return false;
+        }
+
+        if (!continued && (result == EntityScanner::ENTITY || scanner.in_entity())) {
+            // Only objects are entities, other values in the top level array are passed over
+            slot = scanner.entity_kind == '{' ? sampler.pick(candidates++) : -1;
+            current.clear();
+        }
+
+        if (slot >= 0) {
+            current.append(data + entity_start, consumed - entity_start);
+
+            if (result == EntityScanner::ENTITY) {
+                SampledEntity& entity = sampler.chosen[slot];
+                entity.index = candidates - 1;
+                entity.offset = scanner.entity_offset;
+                entity.line = scanner.entity_line;
+                entity.column = scanner.entity_column;
+                entity.bytes.swap(current);
+                slot = -1;
+            }
+        }
+
+        stream_wrapper.Advance(consumed, scanner.current_line(), scanner.current_column());
+    }
+
+    EntityScanner::Result result = scanner.finish();
+
+    if (result == EntityScanner::INCOMPLETE) {
+        scanner.error_code = kParseErrorUnspecificSyntaxError;
+        scanner.error_offset = scanner.offset();
+        scanner.error_line = scanner.current_line();
+        scanner.error_column = scanner.current_column();
+    }
+
+    return result != EntityScanner::ERROR && result != EntityScanner::INCOMPLETE;
+}
+
+// Hands 'k' entities of a file (given by its path) or stream to the handler's 'handle_dict', in document order.
+// They are picked uniformly at random with the given seed or, if 'stride' is not 0, as every 'stride'-th entity
+// (and then at most 'k' of them, unless 'k' is 0). The document is scanned with the GIL released and without
+// building python objects; only the picked entities are parsed. Their structure is checked while scanning, the
+// contents of the other entities are not validated.
+void sample_source(py::object source, py::object handler, size_t k, size_t stride, uint64_t seed,
+                   py::object transit_decode_map, py::object do_float_as_int, py::object py_do_float_as_decimal) {
+    EntityScanner scanner;
+    EntitySampler sampler(k, stride, seed);
+    bool success;
+
+    if (py::isinstance<py::str>(source)) {
+        std::string path = source.cast<std::string>();
+        FileStreamWrapper stream_wrapper(path);
+
+        if (!stream_wrapper.is_open()) {
+            errno = stream_wrapper.open_errno;
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+            throw py::error_already_set();
+        }
+
+        GILReleaser gil_releaser;
+        success = scan_sample(stream_wrapper, scanner, sampler);
+    } else {
+        StreamWrapper stream_wrapper(source);
+        stream_wrapper.gil_released = true;
+
+        GILReleaser gil_releaser;
+        success = scan_sample(stream_wrapper, scanner, sampler);
+    }
+
+    if (!success) {
+        handler.attr("handle_error")((int)scanner.error_code, scanner.error_offset, scanner.error_line,
+                                     scanner.error_column, std::string());
+        handler.attr("handle_end_stream")();
+        return;
+    }
+
+    bool do_float_as_decimal = false;
+    if (!py::isinstance<py::none>(py_do_float_as_decimal)) {
+        do_float_as_decimal = py_do_float_as_decimal.cast<py::bool_>();
+    }
+
+    MyHandlerDict dict_handler(handler, transit_decode_map, do_float_as_int);
+    std::sort(sampler.chosen.begin(), sampler.chosen.end());
+
+    for (const SampledEntity& entity : sampler.chosen) {
+        BufferStreamWrapper stream_wrapper(entity.bytes.data(), entity.bytes.size(), entity.offset, entity.line,
+                                           entity.column);
+        Reader reader;
+
+        if (do_float_as_decimal)
+            reader.Parse<kParseDefaultFlags|kParseNumbersAsStringsFlag>(stream_wrapper, dict_handler);
+        else
+            reader.Parse<kParseDefaultFlags>(stream_wrapper, dict_handler);
+
+        if (reader.HasParseError()) {
+            dict_handler.flush();
+            handler.attr("handle_error")((int)reader.GetParseErrorCode(), reader.GetErrorOffset(),
+                                         stream_wrapper.GetLine(), stream_wrapper.GetColumn(),
+                                         dict_handler.fail_reason);
+            break;
+        }
+    }
+
+    dict_handler.flush();
+    handler.attr("handle_end_stream")();
+}
+
+// The thread pool shared by all parse functions that run on native worker threads. It is created on first use
+// and must be shut down (see shutdown_pool()) before the interpreter is finalized.
+static std::mutex shared_pool_mutex;
+static std::shared_ptr<ThreadPool> shared_pool;
+// Number of threads to use for the next pool that is created, 0 means one per CPU core
+static size_t shared_pool_size = 0;
+
+// Every pool worker keeps a python thread state for as long as it runs, so tasks grabbing the GIL with a
+// GILHolder don't have to create and tear down a new one each time.
+static thread_local PyGILState_STATE worker_gil_state;
+static thread_local PyThreadState* worker_thread_state = nullptr;
+
+// Writes the values the parsers build, i.e. dicts, lists, strings, numbers, booleans, None and Decimals, as JSON.
+// Instances of 'raw_type', the raw subtrees a parse left as text, are written as they are, and other bytes (strings
+// and keys from 'strings_as_bytes' and 'keys_as_bytes') as the UTF-8 strings they hold. Any other value, such as
+// one made by a transit mapping, is handed to 'default_fn' like json.dumps() does, and what it returns is written
+// instead.
+class JSONDumper {
+public:
+    static const int MAX_DEPTH = 1000;
+
+    JSONDumper(py::object raw_type, py::object default_fn)
+        : raw_type(raw_type), default_fn(default_fn), decimal_type(get_decimal_type()), writer(buffer) {}
+
+    py::bytes dump(py::handle value) {
+        write(value.ptr(), 0);
+        return py::bytes(buffer.GetString(), buffer.GetSize());
+    }
+
+private:
+    py::object raw_type;
+    py::object default_fn;
+    py::object decimal_type;
+    StringBuffer buffer;
+    Writer<StringBuffer> writer;
+
+    static bool is_instance(PyObject* value, const py::object& type) {
+        int result = PyObject_IsInstance(value, type.ptr());
+        if (result < 0) {
+            throw py::error_already_set();
+        }
+        return result == 1;
+    }
+
+    void write_string(PyObject* value, bool is_key) {
+        Py_ssize_t length;
+        const char* str;
+
+        if (PyBytes_Check(value)) {
+            str = PyBytes_AS_STRING(value);
+            length = PyBytes_GET_SIZE(value);
+
+            if (!utf8_valid(str, (size_t)length)) {
+                throw py::value_error("Bytes must be valid UTF-8 to be written as a string");
+            }
+        } else {
+            str = PyUnicode_AsUTF8AndSize(value, &length);
+            if (str == nullptr) {
+                throw py::error_already_set();
+            }
+        }
+
+        if (is_key) {
+            writer.Key(str, (SizeType)length);
+        } else {
+            writer.String(str, (SizeType)length);
+        }
+    }
+
+    // Writes the str() of a number that can't be written as an int64 or double
+    void write_number_text(PyObject* value) {
+        py::str text = py::reinterpret_steal<py::str>(PyObject_Str(value));
+        if (!text) {
+            throw py::error_already_set();
+        }
+
+        Py_ssize_t length;
+        const char* str = PyUnicode_AsUTF8AndSize(text.ptr(), &length);
+        writer.RawValue(str, (size_t)length, kNumberType);
+    }
+
+    void write(PyObject* value, int depth) {
+        if (depth > MAX_DEPTH) {
+            throw py::value_error("The value is nested too deeply");
+        }
+
+        if (value == Py_None) {
+            writer.Null();
+        } else if (PyBool_Check(value)) {
+            writer.Bool(value == Py_True);
+        } else if (PyLong_Check(value)) {
+            int overflow;
+            long long number = PyLong_AsLongLongAndOverflow(value, &overflow);
+
+            if (overflow == 0) {
+                writer.Int64(number);
+            } else {
+                write_number_text(value);
+            }
+        } else if (PyFloat_Check(value)) {
+            double number = PyFloat_AS_DOUBLE(value);
+            if (!std::isfinite(number)) {
+                throw py::value_error("Out of range float values are not JSON compliant");
+            }
+            writer.Double(number);
+        } else if (PyUnicode_Check(value)) {
+            write_string(value, false);
+        } else if (PyDict_Check(value)) {
+            writer.StartObject();
+
+            Py_ssize_t position = 0;
+            PyObject* key;
+            PyObject* member;
+
+            while (PyDict_Next(value, &position, &key, &member)) {
+                if (!PyUnicode_Check(key) && !PyBytes_Check(key)) {
+                    throw py::type_error("Keys must be str or bytes, not " + std::string(Py_TYPE(key)->tp_name));
+                }
+                write_string(key, true);
+                write(member, depth + 1);
+            }
+
+            writer.EndObject();
+        } else if (PyList_Check(value)) {
+            writer.StartArray();
+            for (Py_ssize_t i = 0; i < PyList_GET_SIZE(value); i++) {
+                write(PyList_GET_ITEM(value, i), depth + 1);
+            }
+            writer.EndArray();
+        } else if (PyTuple_Check(value)) {
+            writer.StartArray();
+            for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(value); i++) {
+                write(PyTuple_GET_ITEM(value, i), depth + 1);
+            }
+            writer.EndArray();
+        } else if (!raw_type.is_none() && is_instance(value, raw_type)) {
+            char* data;
+            Py_ssize_t length;
+            if (PyBytes_AsStringAndSize(value, &data, &length) < 0) {
+                throw py::error_already_set();
+            }
+            writer.RawValue(data, (size_t)length, kObjectType);
+        } else if (PyBytes_Check(value)) {
+            write_string(value, false);
+        } else if (is_instance(value, decimal_type)) {
+            if (!py::reinterpret_borrow<py::object>(value).attr("is_finite")().cast<bool>()) {
+                throw py::value_error("Out of range Decimal values are not JSON compliant");
+            }
+            write_number_text(value);
+        } else if (!default_fn.is_none()) {
+            py::object replacement = default_fn(py::reinterpret_borrow<py::object>(value));
+            write(replacement.ptr(), depth + 1);
+        } else {
+            throw py::type_error("Object of type " + std::string(Py_TYPE(value)->tp_name) +
+                                 " is not JSON serializable");
+        }
+    }
+};
+
+py::bytes dumps(py::object value, py::object raw_type, py::object default_fn) {
+    JSONDumper dumper(raw_type, default_fn);
+    return dumper.dump(value);
+}
+
+static size_t default_pool_size() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::shared_ptr<ThreadPool> get_shared_pool() {
+    std::lock_guard<std::mutex> lock(shared_pool_mutex);
+
+    if (!shared_pool) {
+        size_t num_threads = shared_pool_size > 0 ? shared_pool_size : default_pool_size();
+
+        shared_pool = std::make_shared<ThreadPool>(num_threads,
+            []() {
+                worker_gil_state = PyGILState_Ensure();
+                worker_thread_state = PyEval_SaveThread();
+            },
+            []() {
+                PyEval_RestoreThread(worker_thread_state);
+                PyGILState_Release(worker_gil_state);
+            });
+    }
+
+    return shared_pool;
+}
+
+void shutdown_pool() {
+    std::shared_ptr<ThreadPool> pool;
+
+    {
+        std::lock_guard<std::mutex> lock(shared_pool_mutex);
+        pool.swap(shared_pool);
+    }
+
+    if (pool) {
+        // Queued tasks need the GIL to finish
+        GILReleaser gil_releaser;
+        pool->shutdown();
+    }
+}
+
+// Sets the number of worker threads in the shared pool (0 means one per CPU core). A running pool is allowed to
+// finish its queued work and is then replaced by a pool of the new size on next use.
+void configure_pool(size_t num_threads) {
+    shutdown_pool();
+
+    std::lock_guard<std::mutex> lock(shared_pool_mutex);
+    shared_pool_size = num_threads;
+}
+
+size_t pool_size() {
+    std::lock_guard<std::mutex> lock(shared_pool_mutex);
+
+    if (shared_pool) {
+        return shared_pool->size();
+    }
+
+    return shared_pool_size > 0 ? shared_pool_size : default_pool_size();
+}
+
+// Called by python code on a pool thread before it waits for a consumer, i.e. in ByteBudgetQueue.put(), so the pool
+// can start a spare thread meanwhile (see ThreadPool::begin_blocking()). Returns false, doing nothing, if the caller
+// is not a pool thread.
+bool pool_begin_blocking() {
+    ThreadPool* pool = ThreadPool::current();
+    if (pool == nullptr) {
+        return false;
+    }
+
+    pool->begin_blocking();
+    return true;
+}
+
+void pool_end_blocking() {
+    ThreadPool* pool = ThreadPool::current();
+    if (pool != nullptr) {
+        pool->end_blocking();
+    }
+}
+
+// Called in the child process after a fork. The worker threads of the parent's pool don't exist in the child
+// (and its locks may be in any state), so the pool object is abandoned without ever being destroyed. The shared
+// pool mutex is only held by threads attached to the interpreter, and python forks with the GIL held (or, on
+// free-threaded builds, with all other threads stopped), so it is free in the child.
+void reset_pool_after_fork() {
+    if (shared_pool) {
+        new std::shared_ptr<ThreadPool>(std::move(shared_pool));
+    }
+}
+
+// Passes the currently raised python exception on to the handler's 'handle_exception' method. The GIL must be held.
+void report_exception(py::object handler) {
+    PyObject *type, *value, *traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+
+    if (value != nullptr && traceback != nullptr) {
+        PyException_SetTraceback(value, traceback);
+    }
+
+    auto type_decref = make_decref_python_ptr(type);
+    auto value_decref = make_decref_python_ptr(value);
+    auto traceback_decref = make_decref_python_ptr(traceback);
+
+    try {
+        if (py::hasattr(handler, "handle_exception")) {
+            handler.attr("handle_exception")(py::reinterpret_borrow<py::object>(value));
+        } else {
+            // Nobody to tell, so print it and end the stream so a consumer waiting for it isn't left hanging
+            Py_XINCREF(type);
+            Py_XINCREF(value);
+            Py_XINCREF(traceback);
+            PyErr_Restore(type, value, traceback);
+            PyErr_WriteUnraisable(handler.ptr());
+
+            handler.attr("handle_end_stream")();
+        }
+    } catch (py::error_already_set& ex) {
+        ex.restore();
+        PyErr_WriteUnraisable(handler.ptr());
+    }
+}
+
+// Shared state of a parse_dict_many() call. It is owned by the pool tasks, the last task to finish deletes it.
+struct ParseManyJob {
+    std::vector<bool> is_path;
+    std::vector<std::string> paths;
+    std::vector<py::object> streams;
+    std::vector<py::object> handlers;
+    // The handlers' cancel tokens, if they have one. A source whose token is cancelled before its task starts is
+    // not opened at all.
+    std::vector<py::object> py_cancel_tokens;
+    std::vector<const CancelToken*> cancel_tokens;
+    py::object on_complete;
+    py::object transit_decode_map;
+    py::object do_float_as_int;
+    py::object do_float_as_decimal;
+    std::atomic<size_t> remaining;
+};
+
+void run_parse_many_task(ParseManyJob* job, size_t index) {
+    std::unique_ptr<FileStreamWrapper> file_stream;
+    const CancelToken* cancel_token = job->cancel_tokens[index];
+    bool cancelled = cancel_token != nullptr && cancel_token->is_cancelled();
+
+    if (job->is_path[index] && !cancelled) {
+        file_stream.reset(new FileStreamWrapper(job->paths[index]));
+
+        // Get the first chunk off the disk before we start waiting for the GIL
+        file_stream->Peek();
+    }
+
+    GILHolder gil_holder;
+
+    py::object handler = job->handlers[index];
+
+    try {
+        if (cancelled) {
+            // Ends like a parse that is cancelled before its first step
+            handler.attr("handle_end_stream")();
+        } else if (file_stream) {
+            if (!file_stream->is_open()) {
+                errno = file_stream->open_errno;
+                PyErr_SetFromErrnoWithFilename(PyExc_OSError, job->paths[index].c_str());
+                throw py::error_already_set();
+            }
+
+            file_stream->holding_gil = true;
+            parse_dict_stream(*file_stream, handler, job->transit_decode_map, job->do_float_as_int,
+                              job->do_float_as_decimal);
+        } else {
+            StreamWrapper stream_wrapper(job->streams[index]);
+            parse_dict_stream(stream_wrapper, handler, job->transit_decode_map, job->do_float_as_int,
+                              job->do_float_as_decimal);
+        }
+    } catch (py::error_already_set& ex) {
+        ex.restore();
+        report_exception(handler);
+    } catch (std::exception& ex) {
+        PyErr_SetString(PyExc_RuntimeError, ex.what());
+        report_exception(handler);
+    }
+
+    if (--job->remaining == 0) {
+        try {
+            job->on_complete();
+        } catch (py::error_already_set& ex) {
+            ex.restore();
+            PyErr_WriteUnraisable(job->on_complete.ptr());
+        }
 
-          // Try to convert the original string to a more suitable format for the error message
-          PyObject *orig_str = PyUnicode_DecodeUTF8(str, (size_t)length, "backslashreplace");
+        delete job;
+    }
+}
 
-          auto orig_str_decref = make_decref_python_ptr(orig_str);
+void parse_dict_many(py::list sources, py::list handlers, py::object on_complete, py::object transit_decode_map,
+                     py::object do_float_as_int, py::object py_do_float_as_decimal) {
+    if (sources.size() != handlers.size()) {
+        throw py::value_error("parse_dict_many() needs exactly one handler per source");
+    }
 
-          const char* raw_python_orig_str = PyUnicode_AsUTF8(orig_str);
-          std::string s_raw_python_orig_str(raw_python_orig_str);
+    if (sources.size() == 0) {
+        on_complete();
+        return;
+    }
 
-          std::stringstream reason;
-          reason << "Failed to decode string '" << s_raw_python_orig_str << "'. Exception raised: " << orig_reason.str();
+    std::unique_ptr<ParseManyJob> job(new ParseManyJob());
+    job->on_complete = on_complete;
+    job->transit_decode_map = transit_decode_map;
+    job->do_float_as_int = do_float_as_int;
+    job->do_float_as_decimal = py_do_float_as_decimal;
+    job->remaining = sources.size();
 
-          fail_reason = reason.str();
-          return false;
-        }
+    for (auto source : sources) {
+        py::object py_source = source.cast<py::object>();
+        bool is_path = py::isinstance<py::str>(py_source) || py::isinstance<py::bytes>(py_source);
 
-        return true;
+        job->is_path.push_back(is_path);
+        job->paths.push_back(is_path ? py_source.cast<std::string>() : std::string());
+        job->streams.push_back(is_path ? py::none() : py_source);
     }
 
-    bool EndObject(SizeType memberCount) {
-        py::object entity = context_stack.back();
+    for (auto handler : handlers) {
+        job->handlers.push_back(handler.cast<py::object>());
 
-        context_stack.pop_back();
+        py::object py_cancel_token = py::getattr(handler, "cancel_token", py::none());
+        job->py_cancel_tokens.push_back(py_cancel_token);
+        job->cancel_tokens.push_back(py::isinstance<CancelToken>(py_cancel_token) ?
+                                     py_cancel_token.cast<CancelToken*>() : nullptr);
+    }
 
-        if (context_stack.size() == 1 && py::isinstance<py::list>(context_stack.back())) {
-            // End of entity in a normal list of entities
+    std::shared_ptr<ThreadPool> pool = get_shared_pool();
+    ParseManyJob* shared_job = job.release();
 
-            dict_handler(entity);
-        }
-        else if (context_stack.size() == 0) {
-            // Allow single object JSON
+    for (size_t i = 0; i < shared_job->handlers.size(); i++) {
+        pool->submit([shared_job, i]() { run_parse_many_task(shared_job, i); });
+    }
+}
 
-            dict_handler(entity);
-        }
-        else {
-            py::object parent = context_stack.back();
 
-            if (py::isinstance<py::dict>(parent)) {
-                // Parent is a dict, add the object to the current property
-                py::str prop_name = name_context.back();
-                name_context.pop_back();
-                py::dict parent_dict = (py::dict)parent;
-                parent_dict[prop_name] = entity;
-            }
-            else {
-                // Parent is a list, append the object
-                py::list parent_list = (py::list)parent;
-                parent_list.append(entity);
-            }
-        }
+// Sets up an empty shared ring in a writable buffer, typically the 'buf' of a multiprocessing SharedMemory block
+void ring_initialize(py::buffer buffer) {
+    py::buffer_info info = buffer.request(true);
 
-        return true;
+    if (!SharedRing::initialize(info.ptr, (size_t)(info.size * info.itemsize))) {
+        throw py::value_error("The buffer is too small for a shared ring");
     }
+}
 
-    bool StartArray() {
-        context_stack.push_back(py::list());
-        return true;
+// Parses the files in 'paths' one after the other and writes their entities to the shared ring in 'buffer', in
+// the binary form of MyHandlerBinary. Meant to run in a worker process; the GIL is released while parsing.
+void parse_to_ring(py::buffer buffer, std::vector<std::string> paths, py::object py_do_float_as_decimal) {
+    py::buffer_info info = buffer.request(true);
+    SharedRing ring(info.ptr);
+
+    if (!ring.is_valid()) {
+        throw py::value_error("The buffer does not contain an initialized shared ring");
     }
 
-    bool EndArray(SizeType elementCount) {
-        py::object list = context_stack.back();
-        context_stack.pop_back();
+    bool do_float_as_decimal = false;
+    if (!py::isinstance<py::none>(py_do_float_as_decimal)) {
+        do_float_as_decimal = py_do_float_as_decimal.cast<py::bool_>();
+    }
 
-        if (context_stack.size() > 0) {
-            py::object parent = context_stack.back();
+    GILReleaser gil_releaser;
 
-            if (py::isinstance<py::dict>(parent)) {
-                py::str prop_name = name_context.back();
-                name_context.pop_back();
-                py::dict parent_dict = (py::dict)parent;
-                parent_dict[prop_name] = list;
-            }
-            else {
-                py::list parent_list = (py::list)parent;
-                parent_list.append(list);
-            }
+    for (const std::string& path : paths) {
+        if (ring.is_abandoned()) {
+            break;
         }
 
-        return true;
-    }
+        FileStreamWrapper stream_wrapper(path);
 
-    MyHandlerDict(py::object py_handler, py::object py_transit_map, py::object do_float_as_int) {
-        dict_handler = py_handler.attr("handle_dict");
+        if (!stream_wrapper.is_open()) {
+            std::string record(sizeof(int32_t), '\0');
+            int32_t open_errno = stream_wrapper.open_errno;
+            std::memcpy(&record[0], &open_errno, sizeof(open_errno));
+            record += path;
 
-        py_Decimal = py::module::import("decimal").attr("Decimal");
+            ring.write(RING_OS_ERROR, record.data(), record.size());
+            ring.write(RING_END_SOURCE, "", 0);
+            continue;
+        }
 
-        if (!py::isinstance<py::none>(do_float_as_int)) {
-            try_float_as_int = do_float_as_int.cast<py::bool_>();
-        } else
-            try_float_as_int = false;
+        Reader reader;
+        MyHandlerBinary my_handler(&ring);
 
-        if (!py::isinstance<py::none>(py_transit_map)) {
-            py::dict transit_decode_map = (py::dict)py_transit_map;
+        reader.IterativeParseInit();
+        while (!reader.IterativeParseComplete() && !reader.HasParseError()) {
+            if (do_float_as_decimal)
+                reader.IterativeParseNext<kParseDefaultFlags|kParseNumbersAsStringsFlag|kParseValidateEncodingFlag>(stream_wrapper, my_handler);
+            else
+                reader.IterativeParseNext<kParseDefaultFlags|kParseValidateEncodingFlag>(stream_wrapper, my_handler);
+        }
 
-            for (auto item : transit_decode_map) {
-                py::object py_key = item.first.cast<py::object>();
-                std::string key = py_key.cast<std::string>();
-                py::object py_value = item.second.cast<py::object>();
-                transit_map.emplace(key, py_value);
-            }
+        if (my_handler.abandoned) {
+            break;
         }
+
+        if (reader.HasParseError()) {
+            uint64_t fields[4] = {(uint64_t)reader.GetParseErrorCode(), (uint64_t)reader.GetErrorOffset(),
+                                  (uint64_t)stream_wrapper.GetLine(), (uint64_t)stream_wrapper.GetColumn()};
+            ring.write(RING_PARSE_ERROR, reinterpret_cast<const char*>(fields), sizeof(fields));
+        }
+
+        ring.write(RING_END_SOURCE, "", 0);
     }
-};
 
+    ring.close();
+}
 
-class MyHandlerString : public BaseReaderHandler<UTF8<>, MyHandlerString> {
+// Reads the records parse_to_ring() writes to a shared ring and turns them into calls to a JSONDictHandler style
+// python handler. The entities are built by a MyHandlerDict, so transit decoding and the float options work just
+// like in parse_dict().
+class SharedRingReader {
 private:
-    py::object py_handler;
-    py::object string_handler;
-    std::vector<int> cursor_stack;
-    TrackingStreamWrapper *tracking_stream;
-    py::object context;
+    std::unique_ptr<py::buffer_info> buffer_info;
+    std::unique_ptr<SharedRing> ring;
+    py::object handler;
+    MyHandlerDict dict_handler;
+    // The parts of an entity that was too big for a single record
+    std::string pending_entity;
+
+    void handle_record(uint32_t type, const char* payload, size_t length) {
+        switch (type) {
+            case RING_ENTITY_PART:
+                pending_entity.append(payload, length);
+                break;
+            case RING_ENTITY: {
+                bool success;
+
+                if (pending_entity.empty()) {
+                    success = replay_binary_entity(payload, length, dict_handler);
+                } else {
+                    pending_entity.append(payload, length);
+                    success = replay_binary_entity(pending_entity.data(), pending_entity.size(), dict_handler);
+                    pending_entity.clear();
+                }
 
-public:
-    bool Null() { return true; }
-    bool Bool(bool b) { return true; }
-    bool Int(int i) { return true; }
-    bool Uint(unsigned u) { return true; }
-    bool Int64(int64_t i) { return true; }
-    bool Uint64(uint64_t u) { return true; }
-    bool Double(double d) { return true; }
-    bool String(const char* str, SizeType length, bool copy) { return true; }
-    bool StartObject() {
-        // cout << "Start Object" << endl;
+                if (!success) {
+                    std::string fail_reason = dict_handler.fail_reason;
+                    dict_handler.reset();
+                    dict_handler.flush();
+                    handler.attr("handle_error")((int)kParseErrorTermination, 0, 0, 0, fail_reason);
+                }
+                break;
+            }
+            case RING_PARSE_ERROR: {
+                uint64_t fields[4];
+                std::memcpy(fields, payload, sizeof(fields));
+                dict_handler.flush();
+                handler.attr("handle_error")((int)fields[0], (size_t)fields[1], (size_t)fields[2],
+                                             (size_t)fields[3], std::string());
+                break;
+            }
+            case RING_END_SOURCE:
+                pending_entity.clear();
+                dict_handler.flush();
+                handler.attr("handle_end_stream")();
+                break;
+            case RING_OS_ERROR: {
+                int32_t open_errno;
+                std::memcpy(&open_errno, payload, sizeof(open_errno));
+                std::string path(payload + sizeof(open_errno), length - sizeof(open_errno));
+
+                errno = open_errno;
+                PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+                report_exception(handler);
+                break;
+            }
+        }
+    }
 
-        if (cursor_stack.size() == 0) {
-            // Clear the accumulation buffer when we start on a toplevel entity
-            tracking_stream->reset_accumulated_buffer();
+public:
+    SharedRingReader(py::buffer buffer, py::object handler, py::object transit_decode_map,
+                     py::object do_float_as_int)
+            : buffer_info(new py::buffer_info(buffer.request(true))),
+              handler(handler),
+              dict_handler(handler, transit_decode_map, do_float_as_int) {
+        ring.reset(new SharedRing(buffer_info->ptr));
+
+        if (!ring->is_valid()) {
+            throw py::value_error("The buffer does not contain an initialized shared ring");
         }
-        cursor_stack.push_back(tracking_stream->Tell());
-        return true;
     }
-    bool Key(const char* str, SizeType length, bool copy) { return true; }
-    bool EndObject(SizeType memberCount) {
-        //cout << "End Object" << endl;
 
-        cursor_stack.pop_back();
+    // Hands up to 'max_records' records to the handler, waiting up to 'timeout_ms' milliseconds for the first one.
+    // Returns the number of records read, or -1 when the writer has closed the ring and everything has been read.
+    long read(size_t max_records, double timeout_ms) {
+        if (!ring) {
+            throw py::value_error("The shared ring reader is closed");
+        }
 
-        if (cursor_stack.size() == 0) {
-            // End of entity
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(timeout_ms);
+        SharedRingBackoff backoff;
+        long records = 0;
 
-            std::string json_data = tracking_stream->accumulated_buffer;
-            json_data += "}";
+        while ((size_t)records < max_records) {
+            uint32_t type;
+            const char* payload;
+            size_t length;
 
-            string_handler(json_data);
+            if (!ring->peek(type, payload, length)) {
+                if (ring->is_closed()) {
+                    // The writer closes the ring after writing its last record, so look once more
+                    if (!ring->peek(type, payload, length)) {
+                        return records > 0 ? records : -1;
+                    }
+                } else {
+                    if (records > 0 || std::chrono::steady_clock::now() >= deadline) {
+                        return records;
+                    }
 
-            // Clear the accumulation buffer
-            tracking_stream->reset_accumulated_buffer();
+                    GILReleaser gil_releaser;
+                    backoff.wait();
+                    continue;
+                }
+            }
+
+            try {
+                handle_record(type, payload, length);
+            } catch (...) {
+                ring->consume(length);
+                throw;
+            }
+
+            ring->consume(length);
+            records++;
         }
 
-        return true;
-    }
-    bool StartArray() {
-        // cout << "Start Array" << endl;
-        return true;
-    }
-    bool EndArray(SizeType elementCount) {
-        //cout << "End Array" << endl;
-        return true;
+        return records;
     }
 
-    MyHandlerString(py::object py_handler, TrackingStreamWrapper *stream) {
-        string_handler = py_handler.attr("handle_string");
-        tracking_stream = stream;
+    // Tells the writer to give up and lets go of the buffer
+    void close() {
+        if (ring) {
+            ring->abandon();
+            ring.reset();
+            buffer_info.reset();
+        }
     }
 };
 
-int parse_strings(py::object stream, py::object handler) {
-
-    Reader reader;
 
-    TrackingStreamWrapper stream_wrapper(stream);
-    MyHandlerString my_handler(handler, &stream_wrapper);
+// Push style parser: chunks of bytes are fed to it as they arrive, and every entity completed by a chunk is handed
+// to the handler's 'handle_dict' before feed() returns. An EntityScanner finds where the top level entities end and
+// each entity is then parsed on its own by a MyHandlerDict. The only state kept between chunks is the scanner
+// state and the bytes of the entity that isn't complete yet.
+class IncrementalParser {
+private:
+    py::object handler;
+    MyHandlerDict dict_handler;
+    EntityScanner scanner;
+    // The bytes of the current entity when it is spread over several chunks
+    std::string entity_buffer;
+    bool do_float_as_decimal;
+    bool failed;
+    bool closed;
+    // Set when the limit was reached or the parse was cancelled, the rest of the input is ignored
+    bool stopped;
+
+    void report_error(int error_code, size_t offset, size_t line_no, size_t column, const std::string& fail_reason) {
+        failed = true;
+        entity_buffer.clear();
+        dict_handler.flush();
+        handler.attr("handle_error")(error_code, offset, line_no, column, fail_reason);
+    }
 
-    reader.IterativeParseInit();
-    while (!reader.IterativeParseComplete() && !reader.HasParseError()) {
-        reader.IterativeParseNext<kParseDefaultFlags>(stream_wrapper, my_handler);
-        // Your handler has been called once.
-        //cout << "Handler was called!" << endl;
+    void report_scanner_error() {
+        report_error((int)scanner.error_code, scanner.error_offset, scanner.error_line, scanner.error_column,
+                     std::string());
     }
 
-    if (reader.HasParseError()) {
-        py::object handle_error = handler.attr("handle_error");
+    bool parse_entity(const char* data, size_t length) {
+        BufferStreamWrapper stream_wrapper(data, length, scanner.entity_offset, scanner.entity_line,
+                                           scanner.entity_column);
+        Reader reader;
 
-        if (handle_error != NULL && !py::isinstance<py::none>(handle_error)) {
-            int error_code = (int)reader.GetParseErrorCode();
-            size_t offset = reader.GetErrorOffset();
-            size_t line_no = stream_wrapper.GetLine();
-            size_t column = stream_wrapper.GetColumn();
+        if (scanner.entity_kind == '{' || !scanner.is_root_array()) {
+            if (do_float_as_decimal)
+                reader.Parse<kParseDefaultFlags|kParseNumbersAsStringsFlag>(stream_wrapper, dict_handler);
+            else
+                reader.Parse<kParseDefaultFlags>(stream_wrapper, dict_handler);
+        } else {
+            // Not an entity, but it must still be valid JSON
+            BaseReaderHandler<UTF8<> > null_handler;
+            reader.Parse<kParseDefaultFlags>(stream_wrapper, null_handler);
+        }
 
-            handle_error(error_code, offset, line_no, column);
+        if (reader.HasParseError()) {
+            std::string fail_reason = dict_handler.fail_reason;
+            dict_handler.reset();
+            report_error((int)reader.GetParseErrorCode(), reader.GetErrorOffset(),
+                         stream_wrapper.GetLine(), stream_wrapper.GetColumn(), fail_reason);
+            return false;
         }
+
+        return true;
     }
 
-    py::object handle_end_stream = handler.attr("handle_end_stream");
-    handle_end_stream();
+public:
+    IncrementalParser(py::object handler, py::object transit_decode_map, py::object do_float_as_int,
+                      py::object py_do_float_as_decimal)
+            : handler(handler), dict_handler(handler, transit_decode_map, do_float_as_int),
+              do_float_as_decimal(false), failed(false), closed(false), stopped(false) {
+        if (!py::isinstance<py::none>(py_do_float_as_decimal)) {
+            do_float_as_decimal = py_do_float_as_decimal.cast<py::bool_>();
+        }
+    }
 
-    //cout << "Finished parsing file" << endl;
+    // Parses the next chunk of the document. Returns false if the document has turned out to be invalid, in which
+    // case 'handle_error' has been called and any further input is ignored.
+    bool feed(py::buffer buffer) {
+        if (closed) {
+            throw py::value_error("feed() called on a closed parser");
+        }
 
-    return 0;
-}
+        if (failed) {
+            return false;
+        }
 
-int parse_dict(py::object stream, py::object handler, py::object transit_decode_map,
-               py::object do_float_as_int, py::object py_do_float_as_decimal) {
-    Reader reader;
+        if (stopped) {
+            return true;
+        }
 
-    StreamWrapper stream_wrapper(stream);
-    MyHandlerDict my_handler(handler, transit_decode_map, do_float_as_int);
+        py::buffer_info info = buffer.request();
+        const char* data = (const char*)info.ptr;
+        size_t length = (size_t)(info.size * info.itemsize);
+        size_t position = 0;
 
-    reader.IterativeParseInit();
-    bool parse_success = true;
-    bool do_float_as_decimal = false;
-    const unsigned int parseFlags = kParseDefaultFlags;
+        while (position < length) {
+            if (dict_handler.should_stop()) {
+                stopped = true;
+                entity_buffer.clear();
+                break;
+            }
 
-    if (!py::isinstance<py::none>(py_do_float_as_decimal)) {
-        do_float_as_decimal = py_do_float_as_decimal.cast<py::bool_>();
-    }
+            size_t consumed;
+            size_t entity_start;
+            bool continued = scanner.in_entity();
+            // Entities before the handler's offset are only scanned
+            bool skipping = scanner.object_count < dict_handler.offset;
 
-    while (!reader.IterativeParseComplete() && !reader.HasParseError()) {
-        if (do_float_as_decimal)
-            parse_success = reader.IterativeParseNext<kParseDefaultFlags|kParseNumbersAsStringsFlag>(stream_wrapper, my_handler);
-        else
-            parse_success = reader.IterativeParseNext<kParseDefaultFlags>(stream_wrapper, my_handler);
-        // Your handler has been called once.
-        //cout << "Handler was called! ParseErrorCode = " << reader.GetParseErrorCode() << " Result was: " << parse_success << endl;
-    }
+            EntityScanner::Result result = scanner.scan(data + position, length - position, consumed, entity_start);
 
-    //cout << "IterativeParseNext finished. Error code = " << reader.GetParseErrorCode() << endl;
+            if (skipping && result != EntityScanner::ERROR) {
+                position += consumed;
+                continue;
+            }
 
-    if (reader.HasParseError()) {
-        py::object handle_error = handler.attr("handle_error");
+            if (result == EntityScanner::ENTITY) {
+                bool success;
 
-        if (handle_error != NULL && !py::isinstance<py::none>(handle_error)) {
-            int error_code = (int)reader.GetParseErrorCode();
-            size_t offset = reader.GetErrorOffset();
-            size_t line_no = stream_wrapper.GetLine();
-            size_t column = stream_wrapper.GetColumn();
+                if (continued) {
+                    entity_buffer.append(data + position, consumed);
+                    success = parse_entity(entity_buffer.data(), entity_buffer.size());
+                    entity_buffer.clear();
+                } else {
+                    // The whole entity is in this chunk, parse it where it is
+                    success = parse_entity(data + position + entity_start, consumed - entity_start);
+                }
 
-            handle_error(error_code, offset, line_no, column, my_handler.fail_reason);
+                if (!success) {
+                    return false;
+                }
+            } else if (result == EntityScanner::ERROR) {
+                report_scanner_error();
+                return false;
+            } else if (scanner.in_entity()) {
+                entity_buffer.append(data + position + entity_start, consumed - entity_start);
+            }
+
+            position += consumed;
         }
-    }
 
-    py::object handle_end_stream = handler.attr("handle_end_stream");
-    handle_end_stream();
+        // The caller picks up what the chunk completed when feed() returns
+        dict_handler.flush();
+        return true;
+    }
 
-    //cout << "Finished parsing file" << endl;
+    // Tells the parser that the document has ended and calls the handler's 'handle_end_stream'. Returns false if
+    // the document was invalid.
+    bool close() {
+        if (closed) {
+            return !failed;
+        }
+        closed = true;
+
+        while (!failed && !stopped && !dict_handler.should_stop()) {
+            bool skipping = scanner.object_count < dict_handler.offset;
+            EntityScanner::Result result = scanner.finish();
+
+            if (result == EntityScanner::ENTITY && skipping) {
+                // Skipped
+            } else if (result == EntityScanner::ENTITY) {
+                // A number or literal ended by the end of the input
+                parse_entity(entity_buffer.data(), entity_buffer.size());
+                entity_buffer.clear();
+            } else if (result == EntityScanner::INCOMPLETE && skipping) {
+                // A skipped entity, so there is nothing for the parser to look at
+                report_error((int)kParseErrorUnspecificSyntaxError, scanner.offset(), scanner.current_line(),
+                             scanner.current_column(), std::string());
+            } else if (result == EntityScanner::INCOMPLETE) {
+                // Let the parser tell what is wrong with it
+                if (parse_entity(entity_buffer.data(), entity_buffer.size())) {
+                    report_error((int)kParseErrorUnspecificSyntaxError, scanner.offset(), scanner.current_line(),
+                                 scanner.current_column(), std::string());
+                }
+            } else if (result == EntityScanner::ERROR) {
+                report_scanner_error();
+            } else {
+                break;
+            }
+        }
 
-    return 0;
-}
+        dict_handler.flush();
+        handler.attr("handle_end_stream")();
+        return !failed;
+    }
+};
 
 
 int parse_string(py::str py_string, py::object handler) {
@@ -1141,7 +4373,13 @@ int parse(py::object stream, py::object handler) {
     return 0;
 }
 
+// All module state is either per parse call, per thread or guarded by its own lock, so the module can run
+// without the GIL on free-threaded python builds.
+#ifdef Py_GIL_DISABLED
+PYBIND11_MODULE(sesam_rapidjson_pybind, m, py::mod_gil_not_used()) {
+#else
 PYBIND11_MODULE(sesam_rapidjson_pybind, m) {
+#endif
     m.doc() = R"pbdoc(
         Pybind11 sesam streaming rapidjson parser plugin
         ------------------------------------------------
@@ -1180,6 +4418,86 @@ PYBIND11_MODULE(sesam_rapidjson_pybind, m) {
         Parser that delivers python dicts for all top level objects in the JSON stream
     )pbdoc");
 
+    m.def("dumps", &dumps, R"pbdoc(
+        Writes a value built by the parsers back to JSON, returned as bytes. Instances of 'raw_type' are bytes of
+        JSON text that are written as they are, other bytes are written as strings. Values of other types are
+        passed to 'default_fn', if not None, and its result is written instead
+    )pbdoc");
+
+    m.def("validate_source", &validate_source, R"pbdoc(
+        Checks that a file (given by its path) or stream is well-formed JSON without building any python objects and
+        with the GIL released. Returns (valid, entities, bytes, error_code, offset, line, column)
+    )pbdoc");
+
+    m.def("sample_source", &sample_source, R"pbdoc(
+        Hands a random sample of 'k' entities (or every 'stride'-th entity) of a file or stream to the handler's
+        'handle_dict', without parsing the others
+    )pbdoc");
+
+    m.def("parse_dict_many", &parse_dict_many, R"pbdoc(
+        Schedules parse_dict() runs for a list of file paths and/or streams on the shared native thread pool and
+        returns immediately. Each source gets its own handler from the 'handlers' list, which must also implement
+        'handle_exception'. The 'on_complete' callable is called when all the sources are done. A handler's
+        'cancel_token' stops its parse, and a source whose token is cancelled before its turn isn't read at all
+    )pbdoc");
+
+    m.def("shutdown_pool", &shutdown_pool, R"pbdoc(
+        Waits for all queued work on the shared native thread pool to finish and stops its threads. The pool is
+        started again on next use
+    )pbdoc");
+
+    m.def("configure_pool", &configure_pool, R"pbdoc(
+        Sets the number of threads in the shared native thread pool (0 means one per CPU core)
+    )pbdoc");
+
+    m.def("pool_size", &pool_size, R"pbdoc(
+        Returns the number of threads in the shared native thread pool
+    )pbdoc");
+
+    m.def("pool_begin_blocking", &pool_begin_blocking, R"pbdoc(
+        Tells the shared native thread pool that the calling pool thread is about to wait for a consumer
+    )pbdoc");
+
+    m.def("pool_end_blocking", &pool_end_blocking, R"pbdoc(
+        Tells the shared native thread pool that the calling pool thread is done waiting
+    )pbdoc");
+
+    m.def("reset_pool_after_fork", &reset_pool_after_fork, R"pbdoc(
+        Forgets the shared native thread pool inherited from the parent process. Only to be called in a forked child
+    )pbdoc");
+
+    m.def("ring_initialize", &ring_initialize, R"pbdoc(
+        Sets up an empty shared ring in a writable buffer (e.g. the 'buf' of a multiprocessing SharedMemory)
+    )pbdoc");
+
+    m.def("parse_to_ring", &parse_to_ring, R"pbdoc(
+        Parses a list of files and writes their entities to a shared ring in a compact binary form, without the GIL
+    )pbdoc");
+
+    py::class_<SharedRingReader>(m, "SharedRingReader", R"pbdoc(
+        Decodes the entities written to a shared ring by parse_to_ring() and hands them to a JSONDictHandler style
+        handler
+    )pbdoc")
+        .def(py::init<py::buffer, py::object, py::object, py::object>())
+        .def("read", &SharedRingReader::read)
+        .def("close", &SharedRingReader::close);
+
+    py::class_<CancelToken>(m, "CancelToken", R"pbdoc(
+        Flag that makes a running parse stop. Set it as the 'cancel_token' attribute of the handler before the parse
+        starts, and call cancel() from any thread.
+    )pbdoc")
+        .def(py::init<>())
+        .def("cancel", &CancelToken::cancel)
+        .def_property_readonly("cancelled", &CancelToken::is_cancelled);
+
+    py::class_<IncrementalParser>(m, "IncrementalParser", R"pbdoc(
+        Push style parser: feed() it chunks of a JSON document as they arrive and the complete entities are handed to
+        the handler's 'handle_dict' right away. close() ends the document
+    )pbdoc")
+        .def(py::init<py::object, py::object, py::object, py::object>())
+        .def("feed", &IncrementalParser::feed)
+        .def("close", &IncrementalParser::close);
+
 #ifdef VERSION_INFO
     m.attr("__version__") = VERSION_INFO;
 #else
@@ -0,0 +1,155 @@
+#ifndef SESAM_RAPIDJSON_NUMBER_TOKEN_H
+#define SESAM_RAPIDJSON_NUMBER_TOKEN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A JSON number as the reader hands it over with kParseNumbersAsStringsFlag, split into its parts. The reader has
+// already checked the syntax: an optional '-', the integer digits, optionally '.' and the fraction digits, and
+// optionally 'e' or 'E', a sign and the exponent digits.
+class NumberToken {
+public:
+    bool negative;
+    const char* int_digits;
+    size_t int_length;
+    const char* frac_digits;
+    size_t frac_length;
+    bool has_exponent;
+    // Clamped to +-1e9, far beyond any value that is worth converting exactly
+    int64_t exponent;
+
+    NumberToken(const char* str, size_t length)
+            : negative(false), int_digits(str), int_length(0), frac_digits(nullptr), frac_length(0),
+              has_exponent(false), exponent(0) {
+        const char* end = str + length;
+        const char* p = str;
+
+        if (p < end && *p == '-') {
+            negative = true;
+            p++;
+        }
+
+        int_digits = p;
+        while (p < end && is_digit(*p)) {
+            p++;
+        }
+        int_length = (size_t)(p - int_digits);
+
+        if (p < end && *p == '.') {
+            frac_digits = ++p;
+            while (p < end && is_digit(*p)) {
+                p++;
+            }
+            frac_length = (size_t)(p - frac_digits);
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            has_exponent = true;
+            p++;
+
+            bool negative_exponent = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative_exponent = *p == '-';
+                p++;
+            }
+
+            while (p < end && is_digit(*p)) {
+                if (exponent < EXPONENT_LIMIT) {
+                    exponent = exponent * 10 + (*p - '0');
+                }
+                p++;
+            }
+            if (negative_exponent) {
+                exponent = -exponent;
+            }
+        }
+    }
+
+    // No fraction and no exponent, i.e. written as an integer
+    bool is_integer() const {
+        return frac_digits == nullptr && !has_exponent;
+    }
+
+    enum Integral {
+        FRACTIONAL,   // The value has a fractional part
+        INTEGRAL,     // A whole number, its digits were put in 'digits'
+        TOO_LONG      // A whole number with more than 'max_digits' digits
+    };
+
+    // Works out from the digits alone if the value is a whole number, like 1.000 or 1e3. If so, and it has at most
+    // 'max_digits' digits, they are put in 'digits' (without the sign and leading zeros, "0" for zero).
+    Integral integral_digits(std::string& digits, size_t max_digits) const {
+        // The value is all_digits * 10^scale, with the trailing zeros of all_digits moved into the scale
+        int64_t scale = exponent - (int64_t)frac_length;
+
+        size_t frac_end = frac_length;
+        while (frac_end > 0 && frac_digits[frac_end - 1] == '0') {
+            frac_end--;
+            scale++;
+        }
+
+        size_t int_end = int_length;
+        if (frac_end == 0) {
+            while (int_end > 0 && int_digits[int_end - 1] == '0') {
+                int_end--;
+                scale++;
+            }
+        }
+
+        size_t int_start = 0;
+        while (int_start < int_end && int_digits[int_start] == '0') {
+            int_start++;
+        }
+
+        digits.clear();
+
+        if (int_start == int_end && frac_end == 0) {
+            digits.push_back('0');
+            return INTEGRAL;
+        }
+
+        if (scale < 0) {
+            return FRACTIONAL;
+        }
+
+        size_t frac_start = 0;
+        if (int_start == int_end) {
+            while (frac_start < frac_end && frac_digits[frac_start] == '0') {
+                frac_start++;
+            }
+        }
+
+        size_t significant = (int_end - int_start) + (frac_end - frac_start);
+        if ((uint64_t)scale > max_digits || significant + (size_t)scale > max_digits) {
+            return TOO_LONG;
+        }
+
+        digits.append(int_digits + int_start, int_end - int_start);
+        digits.append(frac_digits + frac_start, frac_end - frac_start);
+        digits.append((size_t)scale, '0');
+        return INTEGRAL;
+    }
+
+    // Converts up to 19 decimal digits, which always fit in 64 bits. Returns false for longer ones.
+    static bool digits_to_uint64(const char* digits, size_t length, uint64_t& value) {
+        if (length > 19) {
+            return false;
+        }
+
+        value = 0;
+        for (size_t i = 0; i < length; i++) {
+            value = value * 10 + (uint64_t)(digits[i] - '0');
+        }
+        return true;
+    }
+
+private:
+    static const int64_t EXPONENT_LIMIT = 1000000000;
+
+    static bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef SESAM_RAPIDJSON_RAW_JSON_H
+#define SESAM_RAPIDJSON_RAW_JSON_H
+
+#include <cassert>
+#include <cstddef>
+#include <string>
+
+// Records the bytes a Reader takes from a stream while recording is on, so the JSON text of an object or array can
+// be kept exactly as it is in the input. Reader::Parse() has taken a bracket by the time it tells the handler about
+// it, while the iterative parser takes it right after, so start() and finish() are given the bracket and add it
+// themselves where it would be missed.
+class RawRecorder {
+public:
+    RawRecorder() : brackets_taken(true), recording(false) {}
+
+    // Whether the Reader takes brackets before calling the handler, i.e. is not the iterative parser
+    void set_brackets_taken(bool taken) {
+        brackets_taken = taken;
+    }
+
+    void start(char opening) {
+        bytes.clear();
+        if (brackets_taken) {
+            bytes.push_back(opening);
+        }
+        recording = true;
+    }
+
+    void finish(char closing) {
+        if (recording && !brackets_taken) {
+            bytes.push_back(closing);
+        }
+        recording = false;
+    }
+
+    // Stops without finishing the text, i.e. when the value is dropped
+    void stop() {
+        recording = false;
+    }
+
+    void record(char c) {
+        if (recording) {
+            bytes.push_back(c);
+        }
+    }
+
+    const std::string& recorded() const { return bytes; }
+
+private:
+    bool brackets_taken;
+    bool recording;
+    std::string bytes;
+};
+
+// Stream that passes everything taken from another stream to a RawRecorder
+template <typename InputStream>
+class RecordingStream {
+private:
+    InputStream& stream;
+    RawRecorder& recorder;
+
+    RecordingStream(const RecordingStream&);
+    RecordingStream& operator=(const RecordingStream&);
+
+public:
+    typedef typename InputStream::Ch Ch;
+
+    RecordingStream(InputStream& stream, RawRecorder& recorder, bool brackets_taken)
+            : stream(stream), recorder(recorder) {
+        recorder.set_brackets_taken(brackets_taken);
+    }
+
+    Ch Peek() {
+        return stream.Peek();
+    }
+
+    Ch Take() {
+        Ch c = stream.Take();
+        recorder.record(c);
+        return c;
+    }
+
+    size_t Tell() const { return stream.Tell(); }
+
+    size_t GetLine() const { return stream.GetLine(); }
+    size_t GetColumn() const { return stream.GetColumn(); }
+
+    Ch* PutBegin() { assert(false); return 0; }
+    void Put(Ch) { assert(false); }
+    void Flush() { assert(false); }
+    size_t PutEnd(Ch*) { assert(false); return 0; }
+};
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef SESAM_RAPIDJSON_SHARED_RING_H
+#define SESAM_RAPIDJSON_SHARED_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <thread>
+
+// Single producer, single consumer ring of variable sized records in a block of (shared) memory. The producer and
+// the consumer may live in different processes; they only share the memory block, so all coordination goes through
+// the lock-free atomics in the header at the start of it.
+//
+// Positions are byte counters that only ever grow, the physical offset in the data area is the position modulo
+// the capacity. Records are 8 byte aligned and never wrap around the end of the data area: if a record doesn't
+// fit in the space left before the end, a wrap marker is written and the record starts over at offset 0.
+
+struct SharedRingHeader {
+    uint64_t magic;
+    uint64_t capacity;
+    std::atomic<uint64_t> write_pos;
+    std::atomic<uint64_t> read_pos;
+    // Set by the producer when it will not write any more records
+    std::atomic<uint32_t> closed;
+    // Set by the consumer when it is no longer reading, the producer should give up
+    std::atomic<uint32_t> abandoned;
+};
+
+struct SharedRingRecordHeader {
+    uint32_t length;
+    uint32_t type;
+};
+
+static const uint64_t SHARED_RING_MAGIC = 0x73657361726a7331ULL;
+static const size_t SHARED_RING_HEADER_SIZE = 64;
+static const uint32_t SHARED_RING_WRAP = 0xFFFFFFFFu;
+
+static_assert(sizeof(SharedRingHeader) <= SHARED_RING_HEADER_SIZE, "shared ring header too big");
+
+inline uint64_t shared_ring_align(uint64_t n) {
+    return (n + 7) & ~uint64_t(7);
+}
+
+// Waits a bit longer every time it is called, starting with spinning and ending with 1ms sleeps
+class SharedRingBackoff {
+private:
+    unsigned attempt;
+
+public:
+    SharedRingBackoff() : attempt(0) {}
+
+    void wait() {
+        if (attempt < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(attempt < 128 ? 50 : 1000));
+        }
+        attempt++;
+    }
+};
+
+class SharedRing {
+private:
+    SharedRingHeader* header;
+    char* data;
+
+public:
+    // Sets up an empty ring in a block of memory. The block must be 8 byte aligned.
+    static bool initialize(void* memory, size_t size) {
+        if (size < SHARED_RING_HEADER_SIZE + 64) {
+            return false;
+        }
+
+        SharedRingHeader* header = new (memory) SharedRingHeader();
+        header->capacity = (size - SHARED_RING_HEADER_SIZE) & ~uint64_t(7);
+        header->write_pos.store(0);
+        header->read_pos.store(0);
+        header->closed.store(0);
+        header->abandoned.store(0);
+        header->magic = SHARED_RING_MAGIC;
+
+        return true;
+    }
+
+    // Attaches to a ring that has been set up with initialize()
+    SharedRing(void* memory) {
+        header = reinterpret_cast<SharedRingHeader*>(memory);
+        data = reinterpret_cast<char*>(memory) + SHARED_RING_HEADER_SIZE;
+    }
+
+    bool is_valid() const { return header->magic == SHARED_RING_MAGIC; }
+
+    // The largest record payload that can be written in one piece
+    size_t max_record_size() const { return header->capacity / 4; }
+
+    bool is_closed() const { return header->closed.load(std::memory_order_acquire) != 0; }
+    bool is_abandoned() const { return header->abandoned.load(std::memory_order_acquire) != 0; }
+
+    void close() { header->closed.store(1, std::memory_order_release); }
+    void abandon() { header->abandoned.store(1, std::memory_order_release); }
+
+    // Producer side. Blocks while the ring is full; returns false if the consumer has abandoned the ring.
+    bool write(uint32_t type, const char* payload, size_t length) {
+        const uint64_t capacity = header->capacity;
+        const uint64_t record_size = shared_ring_align(sizeof(SharedRingRecordHeader) + length);
+        uint64_t write_pos = header->write_pos.load(std::memory_order_relaxed);
+        uint64_t offset = write_pos % capacity;
+        uint64_t needed = record_size;
+
+        if (offset + record_size > capacity) {
+            // The record must start over at the beginning of the data area
+            needed += capacity - offset;
+        }
+
+        SharedRingBackoff backoff;
+        while (capacity - (write_pos - header->read_pos.load(std::memory_order_acquire)) < needed) {
+            if (is_abandoned()) {
+                return false;
+            }
+            backoff.wait();
+        }
+
+        if (offset + record_size > capacity) {
+            SharedRingRecordHeader wrap = {SHARED_RING_WRAP, 0};
+            std::memcpy(data + offset, &wrap, sizeof(wrap));
+            write_pos += capacity - offset;
+            offset = 0;
+        }
+
+        SharedRingRecordHeader record = {(uint32_t)length, type};
+        std::memcpy(data + offset, &record, sizeof(record));
+        std::memcpy(data + offset + sizeof(record), payload, length);
+
+        header->write_pos.store(write_pos + record_size, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if no record is available, otherwise points 'payload' at the record in the ring.
+    // The record stays valid until consume() is called.
+    bool peek(uint32_t& type, const char*& payload, size_t& length) {
+        const uint64_t capacity = header->capacity;
+        uint64_t read_pos = header->read_pos.load(std::memory_order_relaxed);
+
+        while (true) {
+            if (read_pos == header->write_pos.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            uint64_t offset = read_pos % capacity;
+            SharedRingRecordHeader record;
+            std::memcpy(&record, data + offset, sizeof(record));
+
+            if (record.length == SHARED_RING_WRAP) {
+                read_pos += capacity - offset;
+                header->read_pos.store(read_pos, std::memory_order_release);
+                continue;
+            }
+
+            type = record.type;
+            payload = data + offset + sizeof(record);
+            length = record.length;
+            return true;
+        }
+    }
+
+    void consume(size_t length) {
+        uint64_t read_pos = header->read_pos.load(std::memory_order_relaxed);
+        header->read_pos.store(read_pos + shared_ring_align(sizeof(SharedRingRecordHeader) + length),
+                               std::memory_order_release);
+    }
+};
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef SESAM_RAPIDJSON_THREAD_POOL_H
+#define SESAM_RAPIDJSON_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed size pool of native worker threads. Each worker has its own task deque: it pops new work from the back
+// of its own deque and steals from the front of the other workers' deques when it runs dry. Tasks submitted from
+// outside the pool are spread round-robin over the workers, tasks submitted from a worker go to its own deque.
+//
+// The pool knows nothing about python; tasks that need the GIL must grab it themselves. The optional
+// 'on_thread_start' and 'on_thread_exit' hooks are run on each worker thread when it starts and stops.
+//
+// A task that waits for something outside the pool, i.e. a consumer that reads several parsers in turn, must say so
+// with begin_blocking() and end_blocking(). While workers are blocked, tasks that no idle worker can take are run by
+// spare threads, so blocked workers can't keep the tasks queued behind them from ever starting.
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    explicit ThreadPool(size_t num_threads, Task on_thread_start = Task(), Task on_thread_exit = Task())
+        : pending(0), idle(0), blocked(0), spares(0), spare_threads(0), next_worker(0), stopping(false),
+          on_thread_start(on_thread_start), on_thread_exit(on_thread_exit) {
+        if (num_threads == 0) {
+            num_threads = 1;
+        }
+
+        for (size_t i = 0; i < num_threads; i++) {
+            workers.emplace_back(new Worker());
+        }
+
+        for (size_t i = 0; i < num_threads; i++) {
+            threads.emplace_back(&ThreadPool::run, this, i);
+        }
+    }
+
+    ~ThreadPool() {
+        shutdown();
+    }
+
+    size_t size() const { return workers.size(); }
+
+    void submit(Task task) {
+        WorkerIdentity& current = current_worker();
+        size_t index = (current.pool == this) ? current.index : next_worker++ % workers.size();
+
+        {
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->tasks.push_back(std::move(task));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            pending++;
+            start_spare();
+        }
+        wakeup.notify_one();
+    }
+
+    // The pool the calling thread works for, or nullptr if it is not one of its workers or spare threads
+    static ThreadPool* current() {
+        return current_worker().pool;
+    }
+
+    // Called by a task on this pool before and after it waits for something outside the pool, see above
+    void begin_blocking() {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        blocked++;
+        start_spare();
+    }
+
+    void end_blocking() {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        blocked--;
+    }
+
+    // Lets the workers finish all queued tasks and joins them. Must not be called from a worker thread.
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            if (stopping) {
+                return;
+            }
+            stopping = true;
+        }
+        wakeup.notify_all();
+
+        for (auto& thread : threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+
+        // The spare threads are detached, wait for them to run their exit hook
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        spares_done.wait(lock, [this] { return spare_threads == 0; });
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wakeup;
+    std::condition_variable spares_done;
+    size_t pending;
+    // Workers waiting for a task, tasks that have called begin_blocking(), spare threads taking tasks and spare
+    // threads still running
+    size_t idle;
+    size_t blocked;
+    size_t spares;
+    size_t spare_threads;
+    std::atomic<size_t> next_worker;
+    bool stopping;
+    Task on_thread_start;
+    Task on_thread_exit;
+
+    // Which pool and worker the calling thread is, if it is a worker. A function local static, so the header can be
+    // included by more than one translation unit.
+    struct WorkerIdentity {
+        ThreadPool* pool;
+        size_t index;
+    };
+
+    static WorkerIdentity& current_worker() {
+        static thread_local WorkerIdentity identity = {nullptr, 0};
+        return identity;
+    }
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    // Starts a spare thread if a task is pending that no idle worker can take, and there are fewer spare threads than
+    // blocked tasks. Called with sleep_mutex held.
+    void start_spare() {
+        if (pending > 0 && idle == 0 && spares < blocked && !stopping) {
+            spares++;
+            spare_threads++;
+            std::thread(&ThreadPool::run_spare, this).detach();
+        }
+    }
+
+    bool pop_task(size_t index, Task& task) {
+        {
+            Worker& own = *workers[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < workers.size(); i++) {
+            Worker& victim = *workers[(index + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void run(size_t index) {
+        current_worker().pool = this;
+        current_worker().index = index;
+
+        if (on_thread_start) {
+            on_thread_start();
+        }
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                idle++;
+                wakeup.wait(lock, [this] { return pending > 0 || stopping; });
+                idle--;
+
+                if (pending == 0) {
+                    // Stopping and nothing left to do
+                    break;
+                }
+                pending--;
+            }
+
+            // A task is guaranteed to be queued somewhere for every pending count we take
+            Task task;
+            while (!pop_task(index, task)) {
+                std::this_thread::yield();
+            }
+
+            try {
+                task();
+            } catch (...) {
+                // Tasks are expected to handle their own errors, never let one take the worker down
+            }
+        }
+
+        if (on_thread_exit) {
+            on_thread_exit();
+        }
+
+        current_worker().pool = nullptr;
+    }
+
+    // Takes pending tasks until there are none left. Spare threads steal like the workers do, and submit to the
+    // first worker's deque.
+    void run_spare() {
+        current_worker().pool = this;
+        current_worker().index = 0;
+
+        if (on_thread_start) {
+            on_thread_start();
+        }
+
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                if (pending == 0) {
+                    spares--;
+                    break;
+                }
+                pending--;
+            }
+
+            Task task;
+            while (!pop_task(0, task)) {
+                std::this_thread::yield();
+            }
+
+            try {
+                task();
+            } catch (...) {
+                // See run()
+            }
+        }
+
+        if (on_thread_exit) {
+            on_thread_exit();
+        }
+
+        current_worker().pool = nullptr;
+
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        spare_threads--;
+        spares_done.notify_all();
+    }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SESAM_RAPIDJSON_UINT128_H
+#define SESAM_RAPIDJSON_UINT128_H
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// The full 128-bit product of two 64-bit numbers, with the compiler's 128-bit type or intrinsic where there is one.
+// Used by the exact float conversion (see float_parse.h) and by the sampler to map random numbers to a range.
+struct Uint128 {
+    uint64_t high;
+    uint64_t low;
+};
+
+inline Uint128 multiply_64(uint64_t a, uint64_t b) {
+    Uint128 result;
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = (unsigned __int128)a * b;
+    result.high = (uint64_t)(product >> 64);
+    result.low = (uint64_t)product;
+#elif defined(_MSC_VER) && defined(_M_X64)
+    result.low = _umul128(a, b, &result.high);
+#else
+    uint64_t a_low = a & 0xFFFFFFFF;
+    uint64_t a_high = a >> 32;
+    uint64_t b_low = b & 0xFFFFFFFF;
+    uint64_t b_high = b >> 32;
+    uint64_t low_low = a_low * b_low;
+    uint64_t high_low = a_high * b_low;
+    uint64_t middle = (low_low >> 32) + (high_low & 0xFFFFFFFF) + a_low * b_high;
+    result.high = a_high * b_high + (high_low >> 32) + (middle >> 32);
+    result.low = (middle << 32) | (low_low & 0xFFFFFFFF);
+#endif
+    return result;
+}
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SESAM_RAPIDJSON_UTF8_H
+#define SESAM_RAPIDJSON_UTF8_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SESAM_RAPIDJSON_UTF8_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Decodes the character at s[i], which is not ASCII, into 'code_point'. Returns its length in bytes, or 0 if it is
+// not well-formed UTF-8 (RFC 3629): overlong forms, surrogates and code points above U+10FFFF are rejected.
+inline size_t utf8_decode_char(const unsigned char* s, size_t length, size_t i, uint32_t& code_point) {
+    unsigned char c = s[i];
+    size_t count;
+    // The range of the second byte, which rules out the overlong forms, surrogates and too large code points
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        count = 1;
+        code_point = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        count = 2;
+        code_point = c & 0x0F;
+        if (c == 0xE0) {
+            low = 0xA0;
+        } else if (c == 0xED) {
+            high = 0x9F;
+        }
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        count = 3;
+        code_point = c & 0x07;
+        if (c == 0xF0) {
+            low = 0x90;
+        } else if (c == 0xF4) {
+            high = 0x8F;
+        }
+    } else {
+        return 0;
+    }
+
+    if (length - i <= count || s[i + 1] < low || s[i + 1] > high) {
+        return 0;
+    }
+    for (size_t j = 1; j <= count; j++) {
+        if ((s[i + j] & 0xC0) != 0x80) {
+            return 0;
+        }
+        code_point = (code_point << 6) | (s[i + j] & 0x3F);
+    }
+    return count + 1;
+}
+
+// Returns the length of the ASCII run at the start of data[0..length). Most text is all ASCII, so it is skipped 16
+// bytes at a time with SSE2.
+inline size_t utf8_ascii_length(const char* data, size_t length) {
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+
+#ifdef SESAM_RAPIDJSON_UTF8_SSE2
+    while (i + 16 <= length) {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+        if (mask != 0) {
+            // The first byte that is not ASCII
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return i + index;
+#else
+            return i + (size_t)__builtin_ctz(mask);
+#endif
+        }
+        i += 16;
+    }
+#endif
+    while (i < length && s[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+// Checks that data[0..length) is well-formed UTF-8
+inline bool utf8_valid(const char* data, size_t length) {
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+
+    while (true) {
+        i += utf8_ascii_length(data + i, length - i);
+        if (i == length) {
+            return true;
+        }
+
+        uint32_t code_point;
+        size_t size = utf8_decode_char(s, length, i, code_point);
+        if (size == 0) {
+            return false;
+        }
+        i += size;
+    }
+}
+
+#endif
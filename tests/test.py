@@ -1,7 +1,21 @@
-from sesam_rapidjson import JSONParser, RapidJSONParseError, parse8601
+from sesam_rapidjson import JSONParser, RapidJSONParseError, parse8601, parse_many, configure_pool, pool_size
+from sesam_rapidjson import parse_parallel, AsyncJSONParser, StreamingParser, ByteBudgetQueue, validate, count_entities
+from sesam_rapidjson import sample, RapidJSONEntityError, compile_filter, RawJSON, dumps, JSONDictHandler
+import asyncio
+import itertools
+import math
+import multiprocessing
+import struct
+import threading
+import time
 from pprint import pprint
+import json
+import os
+import tempfile
 from io import FileIO, StringIO, BytesIO
+from datetime import datetime, timedelta
 from decimal import Decimal
+from random import Random
 from ext_types import Nanoseconds, datetime_parse
 
 trans_dict = {
@@ -181,3 +195,697 @@ with BytesIO(b'[{"a": "~f"}]') as stream:
     except RapidJSONParseError as e:
         print(repr(e))
         print("Got expected error!")
+
+
+print("\nTesting parse_many..")
+with tempfile.TemporaryDirectory() as tmp_dir:
+    paths = []
+    for i in range(20):
+        path = os.path.join(tmp_dir, "dataset-%s.json" % i)
+        with open(path, "w") as f:
+            json.dump([{"_id": "%s-%s" % (i, j)} for j in range(50)], f)
+        paths.append(path)
+
+    entities = list(parse_many(paths, ordered=True))
+    assert [e["_id"] for source, e in entities] == ["%s-%s" % (i, j) for i in range(20) for j in range(50)]
+    assert all(source == paths[int(e["_id"].split("-")[0])] for source, e in entities)
+
+    stream = BytesIO(b'[{"_id": "from-stream"}]')
+    entities = list(parse_many(paths + [stream], transit_mapping=trans_dict))
+    assert len(entities) == 20 * 50 + 1
+    assert (stream, {"_id": "from-stream"}) in entities
+
+    try:
+        list(parse_many([os.path.join(tmp_dir, "missing.json")]))
+        raise RuntimeError("This should not work!")
+    except FileNotFoundError:
+        print("Got expected error!")
+
+
+class ReadTrackingStream(BytesIO):
+    # Remembers if the parser has read from it
+    was_read = False
+
+    def read(self, size=-1):
+        self.was_read = True
+        return super().read(size)
+
+
+# Stopping early cancels the parses that are still running, and the queued ones are never read
+data = json.dumps([{"_id": str(i), "s": "x" * 100} for i in range(2000)]).encode("utf-8")
+streams = [ReadTrackingStream(data) for _ in range(500)]
+started = time.time()
+for source, entity in parse_many(streams):
+    break
+assert sum(stream.was_read for stream in streams) < len(streams) // 2
+print("Stopped after %.3f s" % (time.time() - started))
+
+
+print("\nTesting JSONParser on the shared thread pool..")
+configure_pool(2)
+assert pool_size() == 2
+
+for i in range(100):
+    with StringIO('[{"_id": "%s"}, {"_id": "%s-2"}]' % (i, i)) as stream:
+        entities = list(JSONParser(stream, use_pool=True))
+        assert entities == [{"_id": str(i)}, {"_id": "%s-2" % i}]
+
+with StringIO('[{"_id": "1"}, {"_id" "2"}]') as stream:
+    try:
+        list(JSONParser(stream, use_pool=True))
+        raise RuntimeError("This should not work!")
+    except RapidJSONParseError as e:
+        print("Got expected error!")
+
+# More parsers than pool threads, read in turn: the parsers waiting for their consumer must not keep the others
+# from starting
+data = json.dumps([{"_id": str(i), "s": "x" * 100} for i in range(2000)])
+parsers = [JSONParser(StringIO(data), use_pool=True, max_buffer_bytes=4096) for _ in range(5)]
+count = 0
+for entities in zip(*parsers):
+    assert len(set(entity["_id"] for entity in entities)) == 1
+    count += 1
+assert count == 2000
+
+configure_pool(0)
+
+
+print("\nTesting parse_parallel..")
+with tempfile.TemporaryDirectory() as tmp_dir:
+    paths = []
+    for i in range(8):
+        path = os.path.join(tmp_dir, "dataset-%s.json" % i)
+        with open(path, "w") as f:
+            json.dump([{"_id": "%s-%s" % (i, j), "f": "~f1.10", "i": 1.0, "big": "x" * (j * 1000)}
+                       for j in range(200)], f)
+        paths.append(path)
+
+    # A small ring makes the workers wait for us and split the big entities into several records
+    entities = list(parse_parallel(paths, workers=3, transit_mapping=trans_dict, do_float_as_int=True,
+                                   ring_size=256 * 1024, mp_context=multiprocessing.get_context("fork")))
+    assert len(entities) == 8 * 200
+    assert sorted(e["_id"] for path, e in entities) == sorted("%s-%s" % (i, j) for i in range(8) for j in range(200))
+    assert all(path == paths[int(e["_id"].split("-")[0])] for path, e in entities)
+    assert all(e["f"] == Decimal("1.10") and type(e["i"]) == int for path, e in entities)
+
+    with open(paths[3], "a") as f:
+        f.write("garbage")
+
+    try:
+        list(parse_parallel(paths, workers=2, mp_context=multiprocessing.get_context("fork")))
+        raise RuntimeError("This should not work!")
+    except RapidJSONParseError as e:
+        print("Got expected error!")
+
+
+print("\nTesting AsyncJSONParser..")
+
+
+async def chunks(data, size):
+    for i in range(0, len(data), size):
+        await asyncio.sleep(0)
+        yield data[i:i + size]
+
+
+async def parse_async(data, size, **kwargs):
+    reader = asyncio.StreamReader()
+    reader.feed_data(data)
+    reader.feed_eof()
+    from_reader = [e async for e in AsyncJSONParser(reader, chunk_size=size, **kwargs)]
+    from_chunks = [e async for e in AsyncJSONParser(chunks(data, size), **kwargs)]
+    assert from_reader == from_chunks
+    return from_reader
+
+
+expected = [{"_id": str(i), "s": "a \\\" ] } \u00e6", "n": [i, {"x": None}], "f": 1.0} for i in range(100)]
+data = json.dumps(["not an entity", 1] + expected + [[1, 2]]).encode("utf-8")
+
+for size in (1, 2, 7, 64, 100000):
+    entities = asyncio.run(parse_async(data, size, transit_mapping=trans_dict, do_float_as_int=True))
+    assert entities == [dict(e, f=1) for e in expected]
+
+assert asyncio.run(parse_async(b'{"a": 1}', 3)) == [{"a": 1}]
+assert asyncio.run(parse_async(b'[]', 3)) == []
+
+for data in (b'[{"a": 1}, {"a" 2}]', b'[{"a": 1} {"a": 2}]', b'[{"a": 1}, {"a": 2}', b'[{"a": 1}, {"a": "2'):
+    try:
+        asyncio.run(parse_async(data, 4))
+        raise RuntimeError("This should not work!")
+    except RapidJSONParseError as e:
+        print("Got expected error!")
+
+# The offset is counted from the start of the document, not from the start of the entity
+for size in (4, 100000):
+    try:
+        asyncio.run(parse_async(b'[{"a": 1}, {"a" 2}]', size))
+        raise RuntimeError("This should not work!")
+    except RapidJSONParseError as e:
+        assert e.error_code == 5 and e.offset == 16
+        print("Got expected error!")
+
+
+print("\nTesting StreamingParser..")
+data = json.dumps(expected).encode("utf-8")
+
+for size in (1, 5, 1000):
+    with StreamingParser(transit_mapping=trans_dict, do_float_as_int=True) as parser:
+        entities = []
+        for i in range(0, len(data), size):
+            entities.extend(parser.feed(data[i:i + size]))
+        entities.extend(parser.close())
+        assert entities == [dict(e, f=1) for e in expected]
+
+parser = StreamingParser()
+assert parser.feed(b'[{"a": 1}, {"b": 2}, {"c"') == [{"a": 1}, {"b": 2}]
+assert parser.feed(b': 3}, {"d" 4}, {"e": 5}]') == [{"c": 3}]
+try:
+    parser.feed(b'')
+    raise RuntimeError("This should not work!")
+except RapidJSONParseError as e:
+    assert e.offset == 36
+    print("Got expected error!")
+
+parser = StreamingParser()
+assert parser.feed(b'[{"a": 1}, {"b": ') == [{"a": 1}]
+try:
+    parser.close()
+    raise RuntimeError("This should not work!")
+except RapidJSONParseError as e:
+    print("Got expected error!")
+
+
+print("\nTesting batches..")
+data = json.dumps([{"_id": str(i), "s": "x" * 100} for i in range(2500)])
+
+with StringIO(data) as stream:
+    batches = list(JSONParser(stream, batch_size=1000).batches())
+    assert [len(batch) for batch in batches] == [1000, 1000, 500]
+    assert [e["_id"] for batch in batches for e in batch] == [str(i) for i in range(2500)]
+
+with StringIO(data) as stream:
+    batches = list(JSONParser(stream, batch_bytes=10000).batches())
+    assert len(batches) > 10 and all(len(batch) < 100 for batch in batches)
+    assert sum(len(batch) for batch in batches) == 2500
+
+with StringIO(data) as stream:
+    entities = list(JSONParser(stream, batch_size=7, use_pool=True))
+    assert [e["_id"] for e in entities] == [str(i) for i in range(2500)]
+
+with StringIO('[{"_id": "1"}, {"_id": "2"}, {"_id" "3"}]') as stream:
+    batches = []
+    try:
+        for batch in JSONParser(stream, batch_size=10).batches():
+            batches.append(batch)
+        raise RuntimeError("This should not work!")
+    except RapidJSONParseError as e:
+        assert batches == [[{"_id": "1"}, {"_id": "2"}]]
+        print("Got expected error!")
+
+
+class CustomDictHandler(JSONDictHandler):
+    pass
+
+
+try:
+    JSONParser(StringIO(data), handler=CustomDictHandler, batch_size=10)
+    raise RuntimeError("This should not work!")
+except ValueError:
+    print("Got expected error!")
+
+try:
+    JSONParser(StringIO(data), batch_timeout=0.5)
+    raise RuntimeError("This should not work!")
+except ValueError:
+    print("Got expected error!")
+
+
+print("\nTesting the byte budget..")
+queue = ByteBudgetQueue(high_watermark=1000, low_watermark=200)
+queue.put("a", 600)
+queue.put("b", 600)
+put_done = threading.Event()
+thread = threading.Thread(target=lambda: (queue.put("c", 100), put_done.set()))
+thread.start()
+time.sleep(0.1)
+assert not put_done.is_set()
+assert queue.get() == "a"
+time.sleep(0.1)
+# Still above the low watermark
+assert not put_done.is_set()
+assert queue.get() == "b"
+thread.join()
+assert queue.get() == "c" and queue.buffered_bytes() == 0
+
+# A single entity bigger than the budget still gets through
+queue.put("big", 5000)
+assert queue.get() == "big"
+
+data = json.dumps([{"_id": str(i), "s": "x" * 100000} for i in range(50)])
+with StringIO(data) as stream:
+    parser = JSONParser(stream, max_buffer_bytes=500000)
+    assert next(parser)["_id"] == "0"
+    time.sleep(0.2)
+    assert parser._queue.buffered_bytes() <= 600000
+    assert [e["_id"] for e in parser] == [str(i) for i in range(1, 50)]
+
+
+class LegacyDictHandler(JSONDictHandler):
+    # Written before the native parser could pass the entity sizes
+    def handle_dict(self, entity):
+        entity["seen"] = True
+        super().handle_dict(entity)
+
+
+with StringIO('[{"_id": "1"}, {"_id": "2"}]') as stream:
+    entities = list(JSONParser(stream, handler=LegacyDictHandler))
+    assert entities == [{"_id": "1", "seen": True}, {"_id": "2", "seen": True}]
+
+
+print("\nTesting limits and cancellation..")
+data = json.dumps([{"_id": str(i)} for i in range(100000)])
+
+with StringIO(data) as stream:
+    assert [e["_id"] for e in JSONParser(stream, limit=10)] == [str(i) for i in range(10)]
+    # The parser stopped reading right after the tenth entity
+    assert stream.tell() < len(data)
+
+with StringIO(data) as stream:
+    assert list(JSONParser(stream, limit=3, batch_size=2).batches()) == [[{"_id": "0"}, {"_id": "1"}], [{"_id": "2"}]]
+
+for use_pool in (False, True):
+    with StringIO(data) as stream:
+        with JSONParser(stream, max_buffer_bytes=1000, use_pool=use_pool) as parser:
+            assert [e["_id"] for e in itertools.islice(parser, 5)] == [str(i) for i in range(5)]
+        # close() has stopped the parser, so it doesn't block on the full buffer forever
+        assert stream.tell() < len(data)
+
+
+print("\nTesting offsets..")
+data = json.dumps([{"_id": str(i), "s": "] } \\\" {"} for i in range(1000)] + [1, [{"_id": "x"}], {"_id": "last"}])
+
+with StringIO(data) as stream:
+    entities = list(JSONParser(stream, offset=990, limit=5))
+    assert [e["_id"] for e in entities] == [str(i) for i in range(990, 995)]
+
+with StringIO(data) as stream:
+    assert [e["_id"] for e in JSONParser(stream, offset=1000)] == ["last"]
+
+with StringIO(data) as stream:
+    assert list(JSONParser(stream, offset=5000)) == []
+
+with StringIO('{"_id": "single"}') as stream:
+    assert list(JSONParser(stream, offset=1)) == []
+
+for data in ('[{"_id": 1}, ]', '[{"_id": 1} {"_id": 2}]', '[{"_id": 1}, {"_id": 2}', '[{"_id": 1}'):
+    with StringIO(data) as stream:
+        try:
+            list(JSONParser(stream, offset=1))
+            raise RuntimeError("This should not work!")
+        except RapidJSONParseError as e:
+            print("Got expected error!")
+
+# Like limit, offset counts the entities that are yielded, not the other values in the top level array
+data = '[1, {"_id": "a"}, "x", {"_id": "b"}, [2], {"_id": "c"}, null]'
+
+with StringIO(data) as stream:
+    assert [e["_id"] for e in JSONParser(stream, offset=1)] == ["b", "c"]
+
+with StringIO(data) as stream:
+    assert [e["_id"] for e in JSONParser(stream, offset=2, limit=1)] == ["c"]
+
+with StringIO(data) as stream:
+    assert [e["_id"] for e in JSONParser(stream, offset=1, tolerant=True)] == ["b", "c"]
+
+with StringIO(data) as stream:
+    assert [e["_id"] for e in JSONParser(stream, offset=1, where='_id != "b"')] == ["c"]
+
+with StringIO(data) as stream:
+    assert [e["_id"] for e in JSONParser(stream, offset=1, contains=['"b"', '"c"'])] == ["c"]
+
+parser = StreamingParser(offset=2)
+assert parser.feed(data.encode("utf-8")) == [{"_id": "c"}]
+assert parser.close() == []
+
+parser = StreamingParser(offset=2)
+assert parser.feed(b'[{"_id": 1}, {"_id": "}"}, {"_id": 3') == []
+assert parser.feed(b'}, {"_id": 4}]') == [{"_id": 3}, {"_id": 4}]
+assert parser.close() == []
+
+
+print("\nTesting validate and count_entities..")
+data = json.dumps([{"_id": str(i), "n": [{"x": 1.5}]} for i in range(1234)]).encode("utf-8")
+
+with BytesIO(data) as stream:
+    result = validate(stream)
+    assert result.valid and result.entities == 1234 and result.bytes == len(data) and result.error is None
+
+with BytesIO(b'{"a": {"b": {}}}') as stream:
+    assert count_entities(stream) == 1
+
+with BytesIO(b'[{"a": 1},\n {"a" 2}]') as stream:
+    result = validate(stream)
+    assert not result.valid and result.entities == 1
+    assert result.error.offset == 17 and result.error.line_no == 2
+
+with BytesIO(b'["\xff"]') as stream:
+    assert not validate(stream).valid
+
+with tempfile.TemporaryDirectory() as tmp_dir:
+    path = os.path.join(tmp_dir, "data.json")
+    with open(path, "wb") as f:
+        f.write(data)
+    assert count_entities(path) == 1234
+
+    try:
+        count_entities(os.path.join(tmp_dir, "missing.json"))
+        raise RuntimeError("This should not work!")
+    except FileNotFoundError:
+        print("Got expected error!")
+
+
+print("\nTesting sample..")
+data = json.dumps([{"_id": i, "f": "~f1.5"} for i in range(1000)]).encode("utf-8")
+
+with BytesIO(data) as stream:
+    entities = sample(stream, 10, seed=42, transit_mapping=trans_dict)
+    assert len(entities) == 10
+    ids = [e["_id"] for e in entities]
+    assert ids == sorted(set(ids)) and entities[0]["f"] == Decimal("1.5")
+
+with BytesIO(data) as stream:
+    assert [e["_id"] for e in sample(stream, 10, seed=42)] == ids
+
+with BytesIO(data) as stream:
+    assert [e["_id"] for e in sample(stream, stride=100)] == list(range(0, 1000, 100))
+
+with BytesIO(data) as stream:
+    assert [e["_id"] for e in sample(stream, 3, stride=10)] == [0, 10, 20]
+
+with BytesIO(data[:-10]) as stream:
+    try:
+        sample(stream, 10)
+        raise RuntimeError("This should not work!")
+    except RapidJSONParseError:
+        print("Got expected error!")
+
+
+print("\nTesting tolerant mode..")
+data = b'[{"_id": 1}, {"_id": bad}, {"_id": 3} {"_id": 4}, garbage, {"_id": 6}]'
+errors = []
+
+with BytesIO(data) as stream:
+    parser = JSONParser(stream, tolerant=True, on_error=errors.append)
+    assert [e["_id"] for e in parser] == [1, 3, 4, 6]
+    assert parser.errors == errors and len(errors) == 3
+    assert errors[0].raw == b'{"_id": bad}' and errors[0].offset == 21 and errors[0].error_code == 3
+    assert errors[1].error_code == 7 and errors[1].raw == b''
+    assert errors[2].raw == b'garbage'
+
+with BytesIO(data) as stream:
+    assert [e["_id"] for e in JSONParser(stream, tolerant=True, batch_size=2)] == [1, 3, 4, 6]
+
+with BytesIO(data) as stream:
+    try:
+        list(JSONParser(stream))
+        raise RuntimeError("This should not work!")
+    except RapidJSONEntityError:
+        raise RuntimeError("Only tolerant mode should skip entities")
+    except RapidJSONParseError:
+        print("Got expected error!")
+
+
+print("\nTesting field projection..")
+data = json.dumps([{"_id": str(i), "_updated": i, "name": "~f1.5", "skipped": {"a": [1, {"b": "~tnot a date"}]},
+                    "address": [{"city": "Oslo", "zip": "0150"}, {"city": "Bergen"}, "unknown"]}
+                   for i in range(100)]).encode("utf-8")
+
+with BytesIO(data) as stream:
+    entities = list(JSONParser(stream, fields=["_id", "name", ("address", "city")], transit_mapping=trans_dict))
+    assert len(entities) == 100
+    assert entities[7] == {"_id": "7", "name": Decimal("1.5"), "address": [{"city": "Oslo"}, {"city": "Bergen"}]}
+
+with BytesIO(data) as stream:
+    assert list(JSONParser(stream, fields=["address", ["address", "zip"]], limit=1)) == \
+        [{"address": [{"city": "Oslo", "zip": "0150"}, {"city": "Bergen"}, "unknown"]}]
+
+with BytesIO(data) as stream:
+    assert list(JSONParser(stream, fields=[], limit=2)) == [{}, {}]
+
+
+print("\nTesting JSON Pointer extraction..")
+data = json.dumps([{"_id": str(i), "_updated": i, "a/b": {"~": i * 2}, "skipped": [{"b": "~tnot a date"}],
+                    "address": [{"city": "Oslo"}, {"city": "Bergen"}]} for i in range(100)] +
+                  [{"_id": "last"}]).encode("utf-8")
+
+with BytesIO(data) as stream:
+    rows = list(JSONParser(stream, pointers=["/_id", "/_updated", "/address/1/city", "/a~1b/~0", "/address"],
+                           defaults=["", -1, None, 0, []], transit_mapping=trans_dict))
+    assert len(rows) == 101
+    assert rows[3] == ("3", 3, "Bergen", 6, [{"city": "Oslo"}, {"city": "Bergen"}])
+    assert rows[-1] == ("last", -1, None, 0, [])
+
+with BytesIO(data) as stream:
+    try:
+        list(JSONParser(stream, pointers=["_id"]))
+        raise RuntimeError("This should not work!")
+    except ValueError:
+        print("Got expected error!")
+
+print("\nTesting filtering..")
+data = json.dumps([{"_id": str(i), "_deleted": i % 3 == 0, "_updated": i, "type": ["a", "b", "c"][i % 3],
+                    "name": "a%s" % i if i % 2 else "b%s" % i, "skipped": {"b": "~tnot a date"}} for i in range(100)] +
+                  [{"_id": "no type", "_deleted": False, "_updated": 100, "name": "a"}]).encode("utf-8")
+
+where = '_deleted == false and _updated > 10 and type in {"a", "b"} and name =~ "^a"'
+expected = [str(i) for i in range(11, 100) if i % 3 == 1 and i % 2]
+
+with BytesIO(data) as stream:
+    assert [entity["_id"] for entity in JSONParser(stream, where=where)] == expected
+
+with BytesIO(data) as stream:
+    entities = list(JSONParser(stream, where="/skipped/b != null and _id == \"13\"", fields=["_id", "type"]))
+    assert entities == [{"_id": "13", "type": "b"}]
+
+with BytesIO(data) as stream:
+    rows = list(JSONParser(stream, where=[(["_updated"], "<", 3)], pointers=["/_id", "/type"], limit=2))
+    assert rows == [("0", "a"), ("1", "b")]
+
+for expression in ["_id", "_id = 1", "_id == 1 or _id == 2", "type in a"]:
+    try:
+        compile_filter(expression)
+        raise RuntimeError("This should not work!")
+    except ValueError:
+        print("Got expected error!")
+
+print("\nTesting the raw text prefilter..")
+# Only the entities that are parsed have valid dates
+data = json.dumps([{"_id": str(i), "namespace": "ns%s" % (i % 10),
+                    "date": "~t2020-01-01T00:00:00Z" if i % 10 in (0, 7) else "~tnot a date"} for i in range(1000)],
+                  separators=(",", ":")).encode("utf-8")
+
+with BytesIO(data) as stream:
+    entities = list(JSONParser(stream, contains='"_id":"42"'))
+    assert [entity["_id"] for entity in entities] == ["42"]
+
+with BytesIO(data) as stream:
+    entities = list(JSONParser(stream, contains=[b'"ns0"', '"_id":"7"'], transit_mapping=trans_dict))
+    assert [entity["_id"] for entity in entities] == ["0", "7"] + [str(i) for i in range(10, 1000, 10)]
+
+with BytesIO(data) as stream:
+    assert list(JSONParser(stream, contains="not there")) == []
+
+with BytesIO(b'[{"_id": "1"}, {"_id": "2"} {"_id": "3"}]') as stream:
+    try:
+        list(JSONParser(stream, contains='"3"'))
+        raise RuntimeError("This should not work!")
+    except RapidJSONParseError:
+        print("Got expected error!")
+
+print("\nTesting item paths..")
+data = json.dumps({"meta": {"items": [{"_id": "meta"}]},
+                   "data": {"count": 3, "items": [{"_id": str(i), "items": [{"_id": "nested"}]} for i in range(3)]},
+                   "by_id": {str(i): {"value": i} for i in range(3)}}).encode("utf-8")
+
+with BytesIO(data) as stream:
+    assert [entity["_id"] for entity in JSONParser(stream, item_path="data.items.item")] == ["0", "1", "2"]
+
+with BytesIO(data) as stream:
+    assert [entity["_id"] for entity in JSONParser(stream, item_path="data.items.item", offset=1, limit=1)] == ["1"]
+
+with BytesIO(data) as stream:
+    assert list(JSONParser(stream, item_path="by_id", kvitems=True)) == [(str(i), {"value": i}) for i in range(3)]
+
+with BytesIO(data) as stream:
+    assert list(JSONParser(stream, item_path="no.such.item")) == []
+
+# Every value at the prefix is an item, not just the objects
+with BytesIO(b'[1, [2], {"a": 3}]') as stream:
+    assert list(JSONParser(stream, item_path="item")) == [1, [2], {"a": 3}]
+
+with BytesIO(b'[1, [2], {"a": 3}]') as stream:
+    assert list(JSONParser(stream, item_path="item", offset=1, limit=1)) == [[2]]
+
+with BytesIO(b'[1, [2], {"a": 3}]') as stream:
+    assert list(JSONParser(stream, item_path="item", where="a == 3")) == [{"a": 3}]
+
+with BytesIO(b'{"a": 1, "b": "x", "c": [true], "d": {"e": null}}') as stream:
+    assert list(JSONParser(stream, item_path="", kvitems=True)) == [("a", 1), ("b", "x"), ("c", [True]),
+                                                                    ("d", {"e": None})]
+
+print("\nTesting NDJSON and concatenated JSON..")
+lines = [json.dumps({"_id": str(i), "value": i}) for i in range(5)]
+
+with BytesIO(("\n".join(lines) + "\n\n").encode("utf-8")) as stream:
+    assert [entity["_id"] for entity in JSONParser(stream, format="ndjson")] == ["0", "1", "2", "3", "4"]
+
+with BytesIO("\n".join(lines[:3] + ['{"_id": "3", ', lines[4]]).encode("utf-8")) as stream:
+    parser = JSONParser(stream, format="ndjson", tolerant=True)
+    assert [entity["_id"] for entity in parser] == ["0", "1", "2", "4"]
+    assert len(parser.errors) == 1 and parser.errors[0].raw == b'{"_id": "3", '
+
+with BytesIO("".join(lines).encode("utf-8")) as stream:
+    assert [entity["_id"] for entity in JSONParser(stream, format="concat", offset=1, limit=2)] == ["1", "2"]
+
+with BytesIO(("\n".join(lines[:2]) + ' {"_id": "2"}').encode("utf-8")) as stream:
+    try:
+        list(JSONParser(stream, format="ndjson"))
+        raise RuntimeError("This should not work!")
+    except RapidJSONParseError:
+        print("Got expected error!")
+
+print("\nTesting raw subtrees..")
+data = b'[{"_id": "1", "address": { "city" : "Oslo", "zip": [1, 2.50] }, "tags": ["a", "\\u00e5"], "n": 1},' \
+       b' {"_id": "2", "address": {}, "tags": []}]'
+
+with BytesIO(data) as stream:
+    entities = list(JSONParser(stream, raw_depth=1))
+    assert entities[0] == {"_id": "1", "address": b'{ "city" : "Oslo", "zip": [1, 2.50] }',
+                           "tags": b'["a", "\\u00e5"]', "n": 1}
+    assert isinstance(entities[0]["address"], RawJSON) and entities[1]["tags"] == b'[]'
+    assert dumps(entities[0]) == b'{"_id":"1","address":{ "city" : "Oslo", "zip": [1, 2.50] },' \
+                                 b'"tags":["a", "\\u00e5"],"n":1}'
+
+with BytesIO(data) as stream:
+    entities = list(JSONParser(stream, raw_paths=[["address", "zip"]]))
+    assert entities[0]["address"] == {"city": "Oslo", "zip": b'[1, 2.50]'}
+    assert entities[0]["tags"] == ["a", "å"] and entities[1]["address"] == {}
+
+with BytesIO(data) as stream:
+    entities = list(JSONParser(stream, raw_depth=1, fields=["address"]))
+    assert entities == [{"address": b'{ "city" : "Oslo", "zip": [1, 2.50] }'}, {"address": b'{}'}]
+
+assert dumps({"a": [1, 2.5, None, True, "å"], "d": Decimal("1.10"), "t": (1,)}) == \
+    '{"a":[1,2.5,null,true,"å"],"d":1.10,"t":[1]}'.encode("utf-8")
+
+try:
+    dumps({"a": object()})
+    raise RuntimeError("This should not work!")
+except TypeError:
+    print("Got expected error!")
+
+# Values a parse can build with other options go back out as the JSON they came from
+data = '[{"_id": "1", "name": "Åse", "when": "~t2020-01-02T03:04:05Z", "price": "~f1.10"}]'.encode("utf-8")
+mapping = {"t": lambda nanoseconds: datetime(1970, 1, 1) + timedelta(microseconds=nanoseconds // 1000), "f": Decimal}
+
+with BytesIO(data) as stream:
+    entity = list(JSONParser(stream, strings_as_bytes=True, keys_as_bytes=True))[0]
+    assert json.loads(dumps(entity)) == json.loads(data)[0]
+
+with BytesIO(data) as stream:
+    entity = list(JSONParser(stream, transit_mapping=mapping))[0]
+    assert entity["when"] == datetime(2020, 1, 2, 3, 4, 5) and entity["price"] == Decimal("1.10")
+    text = dumps(entity, default=lambda value: value.strftime("~t%Y-%m-%dT%H:%M:%SZ"))
+    assert text == '{"_id":"1","name":"Åse","when":"~t2020-01-02T03:04:05Z","price":1.10}'.encode("utf-8")
+
+with BytesIO(text) as stream:
+    assert list(JSONParser(stream, transit_mapping=mapping, do_float_as_decimal=True)) == [entity]
+
+try:
+    dumps({"name": b"\xc3"})
+    raise RuntimeError("This should not work!")
+except ValueError:
+    print("Got expected error!")
+
+print("\nTesting strings as bytes..")
+data = '[{"_id": "1", "name": "Åse", "tags": ["a", "b"], "n": 1}]'.encode("utf-8")
+
+with BytesIO(data) as stream:
+    assert list(JSONParser(stream, strings_as_bytes=True)) == [{"_id": b"1", "name": "Åse".encode("utf-8"),
+                                                               "tags": [b"a", b"b"], "n": 1}]
+
+with BytesIO(data) as stream:
+    assert list(JSONParser(stream, keys_as_bytes=True, fields=["_id", "n"])) == [{b"_id": "1", b"n": 1}]
+
+with BytesIO(b'[{"name": "\xff"}]') as stream:
+    assert list(JSONParser(stream, strings_as_bytes=True, validate_utf8=False)) == [{"name": b"\xff"}]
+
+with BytesIO(b'[{"name": "\xc3"}]') as stream:
+    try:
+        list(JSONParser(stream, strings_as_bytes=True))
+        raise RuntimeError("This should not work!")
+    except RapidJSONParseError:
+        print("Got expected error!")
+
+print("\nTesting string decoding..")
+values = ["ascii", "", "Åse", "Āber", "€", "\U0001F600 smile", "nul\u0000inside", "x" * 100 + "ÿ"]
+
+with BytesIO(json.dumps([{"_id": value, value: "key"} for value in values]).encode("utf-8")) as stream:
+    assert list(JSONParser(stream)) == [{"_id": value, value: "key"} for value in values]
+
+with BytesIO(b'[{"_id": "1", "name": "ab\xe2\x82"}]') as stream:
+    try:
+        list(JSONParser(stream))
+        raise RuntimeError("This should not work!")
+    except RapidJSONParseError:
+        print("Got expected error!")
+
+print("\nTesting numbers in decimal mode..")
+data = b'[{"i": [0, -0, 42, -9223372036854775808, 18446744073709551615, 123456789012345678901234567890],' \
+       b' "f": [1.000, 1e3, 1.5E1, 0.05e2, -0.0, 12.50, 1e-3, 100e-2, 2.5e30]}]'
+
+with BytesIO(data) as stream:
+    entities = list(JSONParser(stream, do_float_as_int=True, do_float_as_decimal=True))
+    assert entities[0]["i"] == [0, 0, 42, -9223372036854775808, 18446744073709551615, 123456789012345678901234567890]
+    assert entities[0]["f"] == [1, 1000, 15, 5, 0, Decimal("12.50"), Decimal("0.001"), 1, 25 * 10 ** 29]
+    assert [type(value) for value in entities[0]["f"]] == [int] * 5 + [Decimal, Decimal, int, int]
+
+with BytesIO(data) as stream:
+    entities = list(JSONParser(stream, do_float_as_decimal=True))
+    assert entities[0]["f"][:2] == [Decimal("1.000"), Decimal("1e3")] and type(entities[0]["f"][0]) == Decimal
+
+prices = ["0.00", "0.0", "1.00", "100.00", "1.10", "0.00"] * 50
+with BytesIO(("[" + ",".join('{"p": %s, "t": "~f%s"}' % (price, price) for price in prices) + "]").encode()) as stream:
+    entities = list(JSONParser(stream, transit_mapping={"f": Decimal}, do_float_as_decimal=True))
+    assert [str(entity["p"]) for entity in entities] == prices
+    assert [str(entity["t"]) for entity in entities] == prices
+
+print("\nTesting exact floats..")
+rng = Random(50)
+floats = [struct.unpack("<d", struct.pack("<Q", rng.getrandbits(64)))[0] for _ in range(5000)]
+texts = [repr(f) for f in floats if math.isfinite(f)] + ["%.25e" % f for f in floats[:500] if math.isfinite(f)]
+texts += ["0.1", "1e23", "-0.0", "9007199254740993.0", "2.2250738585072011e-308", "4.9406564584124654e-324",
+          "2.4703282292062328e-324", "1.7976931348623157e308", "3.14159265358979323846264338327950288419716939937510"]
+
+with BytesIO(("[" + ",".join('{"f": %s}' % text for text in texts) + "]").encode()) as stream:
+    entities = list(JSONParser(stream, exact_floats=True))
+    assert [repr(entity["f"]) for entity in entities] == [repr(float(text)) for text in texts]
+
+data = b'[{"i": [0, -0, 42, -9223372036854775808, 18446744073709551615, 18446744073709551616], "f": 2.0}]'
+with BytesIO(data) as stream:
+    entities = list(JSONParser(stream, exact_floats=True, do_float_as_int=True))
+    assert entities[0] == {"i": [0, 0, 42, -9223372036854775808, 18446744073709551615, 2.0 ** 64], "f": 2}
+    assert type(entities[0]["i"][-1]) == float
+
+for text in ("1.8e308", "-10.0e308", "1" + "0" * 400):
+    with BytesIO(('[{"f": %s}]' % text).encode()) as stream:
+        try:
+            list(JSONParser(stream, exact_floats=True))
+            raise RuntimeError("This should not work!")
+        except RapidJSONParseError as e:
+            print("Got expected error!")
+
+try:
+    JSONParser(BytesIO(b"[]"), exact_floats=True, do_float_as_decimal=True)
+    raise RuntimeError("This should not work!")
+except ValueError:
+    print("Got expected error!")